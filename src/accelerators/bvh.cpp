@@ -0,0 +1,502 @@
+#include "bvh.h"
+#include "stats.h"
+#include "trace.h"
+#include "pixelcost.h"
+
+namespace apollo {
+
+// BVH Build Structures
+// ====================
+
+// Bounds and centroid of a primitive used during construction
+// The split heuristic works on the box swept over the motion interval; bounds0 and bounds1 are its linear motion bounds
+struct BVHAccel::PrimitiveInfo {
+	PrimitiveInfo(size_t primitiveNumber, const Bounds3f& bounds0, const Bounds3f& bounds1)
+		: primitiveNumber(primitiveNumber), bounds(Union(bounds0, bounds1)), bounds0(bounds0), bounds1(bounds1),
+		  centroid(bounds.pMin * 0.5f + bounds.pMax * 0.5f) {}
+
+	size_t primitiveNumber;
+	Bounds3f bounds, bounds0, bounds1;
+	Point3f centroid;
+};
+
+// Pointer based node used during construction
+struct BVHAccel::BuildNode {
+	void InitLeaf(int first, int n, const Bounds3f& b, const Bounds3f& b0, const Bounds3f& b1) {
+		firstPrimOffset = first;
+		nPrimitives = n;
+		bounds = b;
+		bounds0 = b0;
+		bounds1 = b1;
+		children[0] = children[1] = nullptr;
+	}
+
+	void InitInterior(int axis, BuildNode* c0, BuildNode* c1) {
+		children[0] = c0;
+		children[1] = c1;
+		bounds = Union(c0->bounds, c1->bounds);
+		bounds0 = Union(c0->bounds0, c1->bounds0);
+		bounds1 = Union(c0->bounds1, c1->bounds1);
+		splitAxis = axis;
+		nPrimitives = 0;
+	}
+
+	// Swept bounds and linear motion bounds
+	Bounds3f bounds, bounds0, bounds1;
+	BuildNode* children[2];
+	int splitAxis, firstPrimOffset, nPrimitives;
+};
+
+// BVH Method Definitions
+// ======================
+
+BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p, int maxPrimsInNode)
+	: maxPrimsInNode(std::min(255, maxPrimsInNode)), primitives(std::move(p)) {
+	STAT_PHASE(Build);
+	TRACE_SCOPE("Build BVH", "build");
+	if (primitives.empty())
+		return;
+
+	// Motion interval covering the keyframes of all moving primitives
+	bool hasMotion = false;
+	for (const std::shared_ptr<Primitive>& primitive : primitives) {
+		if (!primitive->IsAnimated())
+			continue;
+		const AnimatedTransform& motion = *primitive->primitiveToWorld;
+		motionStart = hasMotion ? std::min(motionStart, motion.startTime) : motion.startTime;
+		motionEnd = hasMotion ? std::max(motionEnd, motion.endTime) : motion.endTime;
+		hasMotion = true;
+	}
+
+	// Gather bounds and centroids of all primitives
+	std::vector<PrimitiveInfo> primitiveInfo;
+	primitiveInfo.reserve(primitives.size());
+	for (size_t i = 0; i < primitives.size(); i++) {
+		Bounds3f b0, b1;
+		primitives[i]->LinearWorldBounds(motionStart, motionEnd, &b0, &b1);
+		primitiveInfo.emplace_back(i, b0, b1);
+	}
+
+	// Build the hierarchy and reorder primitives so that every leaf references a contiguous range
+	std::vector<std::unique_ptr<BuildNode>> arena;
+	int totalNodes = 0;
+	std::vector<std::shared_ptr<Primitive>> orderedPrimitives;
+	orderedPrimitives.reserve(primitives.size());
+	BuildNode* root = RecursiveBuild(arena, primitiveInfo, 0, (int)primitives.size(), &totalNodes, orderedPrimitives);
+	primitives.swap(orderedPrimitives);
+
+	// Convert to the compact depth-first representation
+	nodes.resize(totalNodes);
+	if (hasMotion)
+		motionBounds.resize(totalNodes);
+	int offset = 0;
+	Flatten(root, &offset);
+
+	BuildTypeSortedShapes();
+}
+
+// Gather the shapes into the type-sorted arrays following the order of primitives
+void BVHAccel::BuildTypeSortedShapes() {
+	primitiveRefs.resize(primitives.size());
+	for (size_t i = 0; i < primitives.size(); i++) {
+		const Shape* shape = primitives[i]->shape;
+		PrimitiveRef& ref = primitiveRefs[i];
+
+		// Moving primitives transform the ray before testing the shape, and spheres that are not intersected in world
+		// space need their object space transform
+		ref.type = primitives[i]->primitiveToWorld ? ShapeType::Other : shape->type;
+		if (ref.type == ShapeType::Sphere && !static_cast<const Sphere*>(shape)->IsWorldSpace())
+			ref.type = ShapeType::Other;
+
+		switch (ref.type) {
+			case ShapeType::Triangle:
+				ref.index = (uint32_t)triangles.size();
+				triangles.push_back(static_cast<const Triangle*>(shape)->Compact());
+				break;
+			case ShapeType::Sphere:
+				ref.index = (uint32_t)spheres.size();
+				spheres.push_back(static_cast<const Sphere*>(shape)->Compact());
+				break;
+			default:
+				ref.index = (uint32_t)i;
+				break;
+		}
+	}
+}
+
+// Intersect the ray with the i-th ordered primitive; a hit is recorded and shrinks the ray extent
+inline bool BVHAccel::IntersectPrimitive(int i, const Ray& ray, HitRecord* hit) const {
+	COST_INC(primitiveTests);
+	const PrimitiveRef ref = primitiveRefs[i];
+	bool intersects;
+	switch (ref.type) {
+		case ShapeType::Triangle:
+			intersects = triangles[ref.index].IntersectHit(ray, hit);
+			break;
+		case ShapeType::Sphere:
+			intersects = spheres[ref.index].IntersectHit(ray, hit);
+			break;
+		default:
+			intersects = primitives[i]->IntersectHit(ray, hit);
+			break;
+	}
+
+	if (!intersects)
+		return false;
+	hit->primitive = primitives[i].get();
+	ray.tMax = hit->t;
+	return true;
+}
+
+// Check if the ray hits the i-th ordered primitive
+inline bool BVHAccel::IntersectPrimitiveP(int i, const Ray& ray) const {
+	COST_INC(primitiveTests);
+	const PrimitiveRef ref = primitiveRefs[i];
+	HitRecord hit;
+	switch (ref.type) {
+		case ShapeType::Triangle:
+			return triangles[ref.index].IntersectHit(ray, &hit);
+		case ShapeType::Sphere:
+			return spheres[ref.index].IntersectHit(ray, &hit);
+		default:
+			return primitives[i]->IntersectHit(ray, &hit);
+	}
+}
+
+// Check if the ray hits the bounds of the i-th node at the ray's time
+inline bool BVHAccel::IntersectNodeP(int i, const Ray& ray, const Vector3f& invDir, const int dirIsNeg[3]) const {
+	if (motionBounds.empty())
+		return nodes[i].bounds.IntersectP(ray, invDir, dirIsNeg);
+
+	// Interpolate as b0 + u * (b1 - b0), which is exact for nodes that do not move
+	const NodeMotionBounds& mb = motionBounds[i];
+	const float u = motionEnd > motionStart ? Clamp((ray.time - motionStart) / (motionEnd - motionStart), 0.0f, 1.0f) : 0.0f;
+	Bounds3f b;
+	b.pMin = mb.b0.pMin + (mb.b1.pMin - mb.b0.pMin) * u;
+	b.pMax = mb.b0.pMax + (mb.b1.pMax - mb.b0.pMax) * u;
+	return b.IntersectP(ray, invDir, dirIsNeg);
+}
+
+BVHAccel::BuildNode* BVHAccel::RecursiveBuild(std::vector<std::unique_ptr<BuildNode>>& arena, std::vector<PrimitiveInfo>& primitiveInfo,
+	int start, int end, int* totalNodes, std::vector<std::shared_ptr<Primitive>>& orderedPrimitives) {
+	arena.emplace_back(new BuildNode());
+	BuildNode* node = arena.back().get();
+	(*totalNodes)++;
+
+	// Compute bounds of all primitives in the node
+	Bounds3f bounds;
+	for (int i = start; i < end; i++)
+		bounds.Union(primitiveInfo[i].bounds);
+
+	auto createLeaf = [&]() {
+		int firstPrimOffset = (int)orderedPrimitives.size();
+		Bounds3f bounds0, bounds1;
+		for (int i = start; i < end; i++) {
+			orderedPrimitives.push_back(primitives[primitiveInfo[i].primitiveNumber]);
+			bounds0.Union(primitiveInfo[i].bounds0);
+			bounds1.Union(primitiveInfo[i].bounds1);
+		}
+		node->InitLeaf(firstPrimOffset, end - start, bounds, bounds0, bounds1);
+		return node;
+	};
+
+	int nPrimitives = end - start;
+	if (nPrimitives == 1)
+		return createLeaf();
+
+	// Choose split dimension from the extent of the centroids
+	Bounds3f centroidBounds(primitiveInfo[start].centroid);
+	for (int i = start; i < end; i++)
+		centroidBounds.Union(primitiveInfo[i].centroid);
+	int dim = centroidBounds.MaximumExtent();
+
+	// All centroids coincide, so there is no meaningful way to split; ranges too large for one leaf, such as stacked
+	// duplicates, are halved so that leaves never exceed maxPrimsInNode
+	int mid = (start + end) / 2;
+	if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) {
+		if (nPrimitives <= maxPrimsInNode)
+			return createLeaf();
+	} else if (nPrimitives <= 2) {
+		// Split into equally sized subsets
+		std::nth_element(&primitiveInfo[start], &primitiveInfo[mid], &primitiveInfo[end - 1] + 1,
+			[dim](const PrimitiveInfo& a, const PrimitiveInfo& b) {
+				return a.centroid[dim] < b.centroid[dim];
+			});
+	} else {
+		// Bucket primitives by centroid and evaluate the surface area heuristic at every bucket boundary
+		constexpr int nBuckets = 12;
+		struct Bucket {
+			int count = 0;
+			Bounds3f bounds;
+		} buckets[nBuckets];
+
+		auto bucketIndex = [&](const PrimitiveInfo& info) {
+			int b = (int)(nBuckets * (info.centroid[dim] - centroidBounds.pMin[dim]) /
+				(centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+			return std::min(b, nBuckets - 1);
+		};
+
+		for (int i = start; i < end; i++) {
+			int b = bucketIndex(primitiveInfo[i]);
+			buckets[b].count++;
+			buckets[b].bounds.Union(primitiveInfo[i].bounds);
+		}
+
+		float cost[nBuckets - 1];
+		for (int i = 0; i < nBuckets - 1; i++) {
+			Bounds3f b0, b1;
+			int count0 = 0, count1 = 0;
+			for (int j = 0; j <= i; j++) {
+				b0.Union(buckets[j].bounds);
+				count0 += buckets[j].count;
+			}
+			for (int j = i + 1; j < nBuckets; j++) {
+				b1.Union(buckets[j].bounds);
+				count1 += buckets[j].count;
+			}
+			float area0 = count0 ? b0.SurfaceArea() : 0.0f;
+			float area1 = count1 ? b1.SurfaceArea() : 0.0f;
+			cost[i] = 0.125f + (count0 * area0 + count1 * area1) / bounds.SurfaceArea();
+		}
+
+		int minCostSplitBucket = (int)(std::min_element(cost, cost + nBuckets - 1) - cost);
+		float leafCost = (float)nPrimitives;
+
+		// Create a leaf if splitting does not pay off
+		if (nPrimitives <= maxPrimsInNode && cost[minCostSplitBucket] >= leafCost)
+			return createLeaf();
+
+		PrimitiveInfo* pMid = std::partition(&primitiveInfo[start], &primitiveInfo[end - 1] + 1,
+			[&](const PrimitiveInfo& info) {
+				return bucketIndex(info) <= minCostSplitBucket;
+			});
+		mid = (int)(pMid - &primitiveInfo[0]);
+
+		// Degenerate partitions fall back to an equal split
+		if (mid == start || mid == end) {
+			mid = (start + end) / 2;
+			std::nth_element(&primitiveInfo[start], &primitiveInfo[mid], &primitiveInfo[end - 1] + 1,
+				[dim](const PrimitiveInfo& a, const PrimitiveInfo& b) {
+					return a.centroid[dim] < b.centroid[dim];
+				});
+		}
+	}
+
+	node->InitInterior(dim,
+		RecursiveBuild(arena, primitiveInfo, start, mid, totalNodes, orderedPrimitives),
+		RecursiveBuild(arena, primitiveInfo, mid, end, totalNodes, orderedPrimitives));
+	return node;
+}
+
+int BVHAccel::Flatten(BuildNode* node, int* offset) {
+	LinearBVHNode* linearNode = &nodes[*offset];
+	linearNode->bounds = node->bounds;
+	if (!motionBounds.empty())
+		motionBounds[*offset] = { node->bounds0, node->bounds1 };
+	int myOffset = (*offset)++;
+
+	if (node->nPrimitives > 0) {
+		linearNode->primitivesOffset = node->firstPrimOffset;
+		linearNode->nPrimitives = (uint16_t)node->nPrimitives;
+	} else {
+		linearNode->axis = (uint8_t)node->splitAxis;
+		linearNode->nPrimitives = 0;
+		Flatten(node->children[0], offset);
+		linearNode->secondChildOffset = Flatten(node->children[1], offset);
+	}
+
+	return myOffset;
+}
+
+// Bounding box of all primitives in world space
+Bounds3f BVHAccel::WorldBound() const {
+	return nodes.empty() ? Bounds3f() : nodes[0].bounds;
+}
+
+// Find the closest intersection between the ray and the primitives
+bool BVHAccel::Intersect(const Ray& ray, SurfaceInteraction* surf) const {
+	if (nodes.empty())
+		return false;
+
+	HitRecord hit;
+	if (!IntersectSubtree(ray, &hit, 0))
+		return false;
+
+	// Only the closest hit gets a full surface interaction
+	*surf = hit.primitive->ComputeSurfaceInteraction(ray, hit);
+	return true;
+}
+
+// Find the closest intersection between the ray and the primitives below the given node
+bool BVHAccel::IntersectSubtree(const Ray& ray, HitRecord* hitRecord, int rootNode) const {
+	bool hit = false;
+	Vector3f invDir(1.0f / ray.d.x, 1.0f / ray.d.y, 1.0f / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+	// Nodes still to be visited
+	int toVisitOffset = 0, currentNodeIndex = rootNode;
+	int nodesToVisit[64];
+
+	while (true) {
+		const LinearBVHNode* node = &nodes[currentNodeIndex];
+		STAT_INC(BVHNodesVisited);
+		COST_INC(traversalSteps);
+		if (IntersectNodeP(currentNodeIndex, ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				// Intersect ray with primitives in leaf node; every hit shrinks ray.tMax
+				for (int i = 0; i < node->nPrimitives; i++)
+					if (IntersectPrimitive(node->primitivesOffset + i, ray, hitRecord))
+						hit = true;
+				if (toVisitOffset == 0)
+					break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			} else {
+				// Visit the near child first
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				} else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		} else {
+			if (toVisitOffset == 0)
+				break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+
+	return hit;
+}
+
+// Check if the ray hits any primitive
+bool BVHAccel::IntersectP(const Ray& ray) const {
+	if (nodes.empty())
+		return false;
+
+	Vector3f invDir(1.0f / ray.d.x, 1.0f / ray.d.y, 1.0f / ray.d.z);
+	int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	int nodesToVisit[64];
+
+	while (true) {
+		const LinearBVHNode* node = &nodes[currentNodeIndex];
+		STAT_INC(BVHNodesVisited);
+		COST_INC(traversalSteps);
+		if (IntersectNodeP(currentNodeIndex, ray, invDir, dirIsNeg)) {
+			if (node->nPrimitives > 0) {
+				for (int i = 0; i < node->nPrimitives; i++)
+					if (IntersectPrimitiveP(node->primitivesOffset + i, ray))
+						return true;
+				if (toVisitOffset == 0)
+					break;
+				currentNodeIndex = nodesToVisit[--toVisitOffset];
+			} else {
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+					currentNodeIndex = node->secondChildOffset;
+				} else {
+					nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+			}
+		} else {
+			if (toVisitOffset == 0)
+				break;
+			currentNodeIndex = nodesToVisit[--toVisitOffset];
+		}
+	}
+
+	return false;
+}
+
+// Find the closest intersection of every ray in the packet
+void BVHAccel::IntersectPacket(const RayPacket& packet, SurfaceInteraction* surfs, bool* hits) const {
+	for (int i = 0; i < packet.size; i++)
+		hits[i] = false;
+	if (nodes.empty())
+		return;
+
+	// Ordered packet traversal needs a bounding frustum and a shared direction octant
+	HitRecord hitRecords[MaxPacketSize];
+	if (!packet.hasFrustum || !packet.SameOctant()) {
+		for (int i = 0; i < packet.size; i++)
+			hits[i] = IntersectSubtree(packet.rays[i], &hitRecords[i], 0);
+	} else
+		IntersectPacketOrdered(packet, hitRecords, hits);
+
+	// Only the closest hit of each ray gets a full surface interaction
+	for (int i = 0; i < packet.size; i++)
+		if (hits[i])
+			surfs[i] = hitRecords[i].primitive->ComputeSurfaceInteraction(packet.rays[i], hitRecords[i]);
+}
+
+// Traverse the hierarchy with the whole packet, front to back
+void BVHAccel::IntersectPacketOrdered(const RayPacket& packet, HitRecord* hitRecords, bool* hits) const {
+
+	const Vector3f& d = packet.rays[0].d;
+	int dirIsNeg[3] = { d.x < 0, d.y < 0, d.z < 0 };
+
+	// Nodes still to be visited along with the rays that reached them
+	struct Entry {
+		int node;
+		uint64_t activeRays;
+	} nodesToVisit[64];
+	int toVisitOffset = 0, currentNodeIndex = 0;
+	uint64_t rayMask = packet.size == 64 ? ~0ULL : (1ULL << packet.size) - 1;
+
+	while (true) {
+		const LinearBVHNode* node = &nodes[currentNodeIndex];
+		STAT_INC(BVHNodesVisited);
+		COST_INC(traversalSteps);
+
+		// Cull the node for the whole packet at once, otherwise find the rays that enter it
+		uint64_t active = 0;
+		int nActive = 0;
+		if (!packet.frustum.Excludes(node->bounds)) {
+			for (int i = 0; i < packet.size; i++) {
+				if (((rayMask >> i) & 1) && IntersectNodeP(currentNodeIndex, packet.rays[i], packet.invDir[i], dirIsNeg)) {
+					active |= 1ULL << i;
+					nActive++;
+				}
+			}
+		}
+
+		if (nActive > 0) {
+			if (4 * nActive < packet.size) {
+				// The packet lost coherence; finish the subtree ray by ray
+				for (int i = 0; i < packet.size; i++)
+					if (((active >> i) & 1) && IntersectSubtree(packet.rays[i], &hitRecords[i], currentNodeIndex))
+						hits[i] = true;
+			} else if (node->nPrimitives > 0) {
+				// Intersect active rays with primitives in leaf node
+				for (int p = 0; p < node->nPrimitives; p++) {
+					for (int i = 0; i < packet.size; i++)
+						if (((active >> i) & 1) && IntersectPrimitive(node->primitivesOffset + p, packet.rays[i], &hitRecords[i]))
+							hits[i] = true;
+				}
+			} else {
+				// Visit the near child first
+				if (dirIsNeg[node->axis]) {
+					nodesToVisit[toVisitOffset++] = { currentNodeIndex + 1, active };
+					currentNodeIndex = node->secondChildOffset;
+				} else {
+					nodesToVisit[toVisitOffset++] = { node->secondChildOffset, active };
+					currentNodeIndex = currentNodeIndex + 1;
+				}
+				rayMask = active;
+				continue;
+			}
+		}
+
+		if (toVisitOffset == 0)
+			break;
+		toVisitOffset--;
+		currentNodeIndex = nodesToVisit[toVisitOffset].node;
+		rayMask = nodesToVisit[toVisitOffset].activeRays;
+	}
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef APOLLO_ACCELERATORS_BVH_H
+#define APOLLO_ACCELERATORS_BVH_H
+
+#include "apollo.h"
+#include "bounds3.h"
+#include "ray.h"
+#include "raypacket.h"
+#include "interaction.h"
+#include "primitive.h"
+#include "triangle.h"
+#include "sphere.h"
+
+namespace apollo {
+
+// Node of the flattened BVH; stored in depth-first order so the first child directly follows its parent
+struct LinearBVHNode {
+	Bounds3f bounds;
+	union {
+		// Leaf: offset of the first primitive
+		int primitivesOffset;
+		// Interior: offset of the second child
+		int secondChildOffset;
+	};
+	// 0 for interior nodes
+	uint16_t nPrimitives;
+	// Split axis of interior nodes
+	uint8_t axis;
+};
+
+// Bounds of a node at the start and the end of the scene's motion interval; rays test them interpolated to their time
+struct NodeMotionBounds {
+	Bounds3f b0, b1;
+};
+
+// Concrete type of an ordered primitive's shape and its index in the matching type-sorted array
+struct PrimitiveRef {
+	ShapeType type;
+	uint32_t index;
+};
+
+// Bounding volume hierarchy built with the surface area heuristic
+// The intersection data of triangles and world space spheres (mesh and vertex indices, center and radius) is gathered
+// into contiguous per-type arrays in traversal order, so leaves test them directly (switching on the shape type)
+// instead of going through the Shape vtable; other shapes keep the virtual call
+// With moving primitives, every node also keeps linear bounds over the motion interval. A ray only tests the box at its
+// own time, which is much tighter than the box swept over the whole interval, so motion blur hardly slows traversal
+class BVHAccel {
+	public:
+		BVHAccel(std::vector<std::shared_ptr<Primitive>> primitives, int maxPrimsInNode = 4);
+
+		// Bounding box of all primitives in world space
+		Bounds3f WorldBound() const;
+
+		// Find the closest intersection between the ray and the primitives
+		bool Intersect(const Ray& ray, SurfaceInteraction* surf) const;
+
+		// Check if the ray hits any primitive
+		bool IntersectP(const Ray& ray) const;
+
+		// Find the closest intersection of every ray in the packet; hits[i] tells whether packet.rays[i] hit anything
+		// Nodes outside the packet frustum are culled as a whole. Once too few rays remain active in a subtree,
+		// the remaining rays are traced through it one by one
+		void IntersectPacket(const RayPacket& packet, SurfaceInteraction* surfs, bool* hits) const;
+
+	private:
+		// Find the closest intersection between the ray and the primitives below the given node
+		// Only the hit record is kept during traversal; the caller builds the surface interaction for the final hit
+		bool IntersectSubtree(const Ray& ray, HitRecord* hit, int rootNode) const;
+
+		// Traverse the hierarchy with the whole packet (which must share a direction octant and have a frustum)
+		void IntersectPacketOrdered(const RayPacket& packet, HitRecord* hitRecords, bool* hits) const;
+
+		// Intersect the ray with the i-th ordered primitive; a hit is recorded and shrinks the ray extent
+		inline bool IntersectPrimitive(int i, const Ray& ray, HitRecord* hit) const;
+
+		// Check if the ray hits the i-th ordered primitive
+		inline bool IntersectPrimitiveP(int i, const Ray& ray) const;
+
+		// Check if the ray hits the bounds of the i-th node at the ray's time
+		inline bool IntersectNodeP(int i, const Ray& ray, const Vector3f& invDir, const int dirIsNeg[3]) const;
+
+		// Gather the shapes into the type-sorted arrays following the order of primitives
+		void BuildTypeSortedShapes();
+
+		struct BuildNode;
+		struct PrimitiveInfo;
+
+		// Recursively build the hierarchy over primitiveInfo[start, end)
+		BuildNode* RecursiveBuild(std::vector<std::unique_ptr<BuildNode>>& arena, std::vector<PrimitiveInfo>& primitiveInfo,
+			int start, int end, int* totalNodes, std::vector<std::shared_ptr<Primitive>>& orderedPrimitives);
+
+		// Flatten the hierarchy into the nodes array
+		int Flatten(BuildNode* node, int* offset);
+
+		const int maxPrimsInNode;
+		std::vector<std::shared_ptr<Primitive>> primitives;
+		std::vector<LinearBVHNode> nodes;
+
+		// Per ordered primitive type tags and the type-sorted intersection data they index
+		std::vector<PrimitiveRef> primitiveRefs;
+		std::vector<CompactTriangle> triangles;
+		std::vector<CompactSphere> spheres;
+
+		// Per node linear bounds over [motionStart, motionEnd] (empty if no primitive moves)
+		std::vector<NodeMotionBounds> motionBounds;
+		float motionStart = 0.0f, motionEnd = 0.0f;
+};
+
+}
+
+#endif
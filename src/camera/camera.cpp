@@ -3,25 +3,122 @@
 
 namespace apollo {
 
-Camera::Camera(Film& film, float fov, Point3f& pos, Point3f& look, Vector3f& up) : film(film), fov(fov), aspectRatio((float)film.resolution.x / film.resolution.y) {
+Camera::Camera(Film& film, float fov, Point3f& pos, Point3f& look, Vector3f& up, float lensRadius, float focalDistance,
+	float shutterOpen, float shutterClose)
+	: film(film), fov(fov), aspectRatio((float)film.resolution.x / film.resolution.y), lensRadius(lensRadius), focalDistance(focalDistance),
+	  shutterOpen(shutterOpen), shutterClose(shutterClose) {
 	InitializeTransformations(pos, look, up);
 }
 
 void Camera::InitializeTransformations(Point3f& pos, Point3f& look, Vector3f& up) {
 	worldToCamera = LookAt(pos, look, up);
 	cameraToWorld = worldToCamera.Inverse();
+
+	// Map raster [0, res.x] x [0, res.y] to [-tan(fov/2) * aspect, tan(fov/2) * aspect] x [tan(fov/2), -tan(fov/2)] at z = 1
+	const float tanHalfFov = std::tan(fov / 2);
+	Vector3f corner(-tanHalfFov * aspectRatio, tanHalfFov, 1.0f);
+	rasterToCamera = Translate(corner) * Scale(2 * tanHalfFov * aspectRatio / film.resolution.x, -2 * tanHalfFov / film.resolution.y, 1.0f);
+
+	origin = cameraToWorld(Point3f(0.0f));
+	dirPixel00 = cameraToWorld(rasterToCamera(Point3f(0.5f, 0.5f, 0.0f)) - Point3f(0.0f));
+	dxRaster = cameraToWorld(rasterToCamera(Vector3f(1.0f, 0.0f, 0.0f)));
+	dyRaster = cameraToWorld(rasterToCamera(Vector3f(0.0f, 1.0f, 0.0f)));
+
+	// The lens lies in the camera's xy plane
+	lensU = cameraToWorld(Vector3f(lensRadius, 0.0f, 0.0f));
+	lensV = cameraToWorld(Vector3f(0.0f, lensRadius, 0.0f));
 }
 
+// The raster directions have unit length along the view axis, so scaling them by the focal distance reaches the plane in focus
+Ray Camera::GenerateRay(const CameraSample& sample) const {
+	Vector3f d = RasterDirection(sample.pFilm.x, sample.pFilm.y);
+	const float time = ShutterTime(sample.time);
+	if (!HasLens())
+		return Ray(origin, d.Normalized(), Infinity, time);
+
+	Vector3f lensOffset = LensOffset(sample.pLens);
+	return Ray(origin + lensOffset, (d * focalDistance - lensOffset).Normalized(), Infinity, time);
+}
+
+RayDifferential Camera::GenerateRayDifferential(const CameraSample& sample) const {
+	return AddDifferentials(GenerateRay(sample), sample);
+}
+
+RayDifferential Camera::AddDifferentials(const Ray& primary, const CameraSample& sample) const {
+	Vector3f d = RasterDirection(sample.pFilm.x, sample.pFilm.y);
+	RayDifferential ray(primary);
+	ray.rxOrigin = ray.ryOrigin = primary.o;
+	if (!HasLens()) {
+		ray.rxDirection = (d + dxRaster).Normalized();
+		ray.ryDirection = (d + dyRaster).Normalized();
+	} else {
+		// The auxiliary rays leave from the same lens position towards their own points in focus
+		Vector3f lensOffset = LensOffset(sample.pLens);
+		ray.rxDirection = ((d + dxRaster) * focalDistance - lensOffset).Normalized();
+		ray.ryDirection = ((d + dyRaster) * focalDistance - lensOffset).Normalized();
+	}
+	ray.hasDifferentials = true;
+	return ray;
+}
+
+void Camera::GenerateRays(const Point2i& pMin, const Point2i& pMax, const CameraSample* samples, const RaySoA& rays) const {
+	const int width = pMax.x - pMin.x;
+	const bool lens = HasLens() && samples;
+	for (int y = pMin.y, row = 0; y < pMax.y; y++, row++) {
+		// Direction at the start of the row; only x varies along it
+		const Vector3f rowStart = dirPixel00 + dyRaster * (float)y;
+		for (int i = row * width, x = pMin.x; x < pMax.x; x++, i++) {
+			float fx = (float)x, fy = 0.0f;
+			if (samples) {
+				fx = samples[i].pFilm.x;
+				fy = samples[i].pFilm.y - (float)y;
+			}
+			float dx = rowStart.x + dxRaster.x * fx + dyRaster.x * fy;
+			float dy = rowStart.y + dxRaster.y * fx + dyRaster.y * fy;
+			float dz = rowStart.z + dxRaster.z * fx + dyRaster.z * fy;
+			Point3f o = origin;
+
+			if (lens) {
+				// Aim from the lens position at the point in focus
+				Vector3f lensOffset = LensOffset(samples[i].pLens);
+				o += lensOffset;
+				dx = dx * focalDistance - lensOffset.x;
+				dy = dy * focalDistance - lensOffset.y;
+				dz = dz * focalDistance - lensOffset.z;
+			}
+			float invLength = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+
+			rays.ox[i] = o.x;
+			rays.oy[i] = o.y;
+			rays.oz[i] = o.z;
+			rays.dx[i] = dx * invLength;
+			rays.dy[i] = dy * invLength;
+			rays.dz[i] = dz * invLength;
+			rays.time[i] = ShutterTime(samples ? samples[i].time : 0.0f);
+		}
+	}
+}
 
-Ray Camera::GenerateRay(float x, float y) {
-	// Convert from raster to screen space 
-	x = (2 * ((x + 0.5) / film.resolution.x) - 1) * tan(fov/2) * aspectRatio;
-	y = (1 - 2 * ((y + 0.5) / film.resolution.y))  * tan(fov/2);
+void Camera::GenerateRayPacket(const Point2i& pMin, const Point2i& pMax, const CameraSample* samples, RayPacket* packet) const {
+	// Generate the directions in bulk, then build the rays
+	float ox[MaxPacketSize], oy[MaxPacketSize], oz[MaxPacketSize];
+	float dx[MaxPacketSize], dy[MaxPacketSize], dz[MaxPacketSize];
+	float time[MaxPacketSize];
+	GenerateRays(pMin, pMax, samples, RaySoA{ ox, oy, oz, dx, dy, dz, time });
 
-	Ray r(Point3f(0), Vector3f(x, y, -1).Normalized());
+	const int n = (pMax.x - pMin.x) * (pMax.y - pMin.y);
+	packet->Clear();
+	for (int i = 0; i < n; i++)
+		packet->Add(Ray(Point3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i]), Infinity, time[i]));
+	if (HasLens() && samples)
+		return;
 
-	// Returns ray in world space
-	return cameraToWorld(r);
+	// Span the frustum through the block corners, widened slightly so rays on the border stay inside
+	const float margin = 0.01f;
+	const float x0 = pMin.x - 0.5f - margin, x1 = pMax.x - 0.5f + margin;
+	const float y0 = pMin.y - 0.5f - margin, y1 = pMax.y - 0.5f + margin;
+	Vector3f corners[4] = { RasterDirection(x0, y0), RasterDirection(x1, y0), RasterDirection(x1, y1), RasterDirection(x0, y1) };
+	packet->SetFrustum(origin, corners);
 }
 
 }
@@ -3,33 +3,108 @@
 
 #include "apollo.h"
 #include "ray.h"
+#include "raypacket.h"
 #include "transform.h"
 #include "film.h"
+#include "sampling.h"
 
 namespace apollo {
 
-// Perspective camera model
+// Sample values that pick one primary ray
+struct CameraSample {
+	// Film position in raster coordinates (integers are pixel centers)
+	Point2f pFilm;
+	// Position on the lens in [0, 1)^2
+	Point2f pLens;
+	// Fraction of the shutter interval in [0, 1)
+	float time;
+};
+
+// Destination of batch ray generation in structure-of-arrays layout; every array receives one entry per ray
+struct RaySoA {
+	float *ox, *oy, *oz;
+	float *dx, *dy, *dz;
+	float *time;
+};
+
+// Perspective camera model with a thin lens and a shutter interval
+// A zero lens radius gives a pinhole camera whose rays share a common origin. Otherwise every ray leaves from a point
+// on the lens towards the point in focus, which lies focalDistance in front of the lens, so only that plane is sharp.
+// Rays get a time within [shutterOpen, shutterClose], which blurs moving objects.
+// All ray generation constants are precomputed, so the direction through a raster position is two fused multiply-adds
+// per component followed by a normalization
 class Camera {
 	public:
-		Camera(Film& film, float fov, Point3f& pos, Point3f& look, Vector3f& up);
+		Camera(Film& film, float fov, Point3f& pos, Point3f& look, Vector3f& up, float lensRadius = 0.0f, float focalDistance = 1.0f,
+		       float shutterOpen = 0.0f, float shutterClose = 0.0f);
+
+		// Generate primary ray in world space for a camera sample
+		Ray GenerateRay(const CameraSample& sample) const;
+
+		// Generate primary ray with auxiliary rays through (x + 1, y) and (x, y + 1) from the same lens position
+		RayDifferential GenerateRayDifferential(const CameraSample& sample) const;
+
+		// Add the auxiliary rays of a sample to the primary ray generated for it (e.g. by GenerateRayPacket), which is kept as is
+		RayDifferential AddDifferentials(const Ray& primary, const CameraSample& sample) const;
+
+		// Generate normalized primary rays for the pixel block [pMin, pMax) in row-major order into SoA arrays
+		// samples holds one camera sample per pixel (nullptr samples the pixel centers through the lens center at shutter open)
+		void GenerateRays(const Point2i& pMin, const Point2i& pMax, const CameraSample* samples, const RaySoA& rays) const;
+
+		// Generate primary rays for the pixel block [pMin, pMax) in row-major order
+		// Pinhole rays are bounded by a common frustum; thin lens rays have no common apex and are left without one
+		void GenerateRayPacket(const Point2i& pMin, const Point2i& pMax, const CameraSample* samples, RayPacket* packet) const;
+
+		// Check if the camera has a lens aperture
+		bool HasLens() const { return lensRadius > 0.0f; }
 
-		// Generate primary ray in world space given film (x, y) coordinates
-		Ray GenerateRay(float x, float y);
 	private:
 
 		void InitializeTransformations(Point3f& pos, Point3f& look, Vector3f& up);
 
-		const Film film;
-		
-		// Image aspect ratio (width / height)
-		const float aspectRatio;
+		// Unnormalized world space direction through film (x, y) coordinates
+		Vector3f RasterDirection(float x, float y) const {
+			return dirPixel00 + dxRaster * x + dyRaster * y;
+		}
+
+		// World space offset of a lens sample from the lens center
+		Vector3f LensOffset(const Point2f& u) const {
+			Point2f pLens = ConcentricSampleDisk(u);
+			return lensU * pLens.x + lensV * pLens.y;
+		}
+
+		// Ray time of a shutter fraction
+		float ShutterTime(float u) const {
+			return Lerp(u, shutterOpen, shutterClose);
+		}
+
+		const Film& film;
 		
 		// Camera field of view (in radians)
 		const float fov;
+
+		// Image aspect ratio (width / height)
+		const float aspectRatio;
 	
 		// Transformation from world to camera space and vice versa
 		Transform worldToCamera;
 		Transform cameraToWorld;
+
+		// Transformation from continuous raster coordinates to the image plane at z = 1 in camera space
+		Transform rasterToCamera;
+
+		// Precomputed ray generation constants in world space: the camera position, the direction through the
+		// center of pixel (0, 0) and its change per raster unit in x and y
+		Point3f origin;
+		Vector3f dirPixel00, dxRaster, dyRaster;
+
+		// Thin lens: radius of the aperture, distance of the plane in focus along the view direction and the world space
+		// lens axes scaled by the lens radius
+		const float lensRadius, focalDistance;
+		Vector3f lensU, lensV;
+
+		// Interval during which the shutter is open
+		const float shutterOpen, shutterClose;
 };
 
 }
@@ -10,6 +10,8 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <cstdint>
+#include <cstring>
 
 namespace apollo {
 
@@ -24,10 +26,12 @@ template <typename T> class Bounds3;
 class Ray;
 class Matrix;
 class Transform;
+class AnimatedTransform;
 class Shape;
 class Interaction;
 class SurfaceInteraction;
 class Primitive;
+struct HitRecord;
 class RGB;
 class Film;
 class Camera;
@@ -38,21 +42,27 @@ static constexpr float Infinity = std::numeric_limits<float>::infinity();
 static constexpr float Epsilon = std::numeric_limits<float>::epsilon();
 static constexpr float PI = 3.14159265358979323846;
 static constexpr float InvPI = 0.31830988618379067154;
+// Half the gap between 1 and the next float (the rounding error bound of a single operation)
+static constexpr float MachineEpsilon = std::numeric_limits<float>::epsilon() * 0.5f;
+// Fraction of a shadow ray cut off at the light end, so the light's own surface is not hit
+static constexpr float ShadowEpsilon = 0.0001f;
 
 // Mathematical routines
 // =====================
 
 // Solve quadratic equation
 inline bool Quadratic(float a, float b, float c, float &x1, float &x2) {
-	// Calculate discriminant
-	float d = b * b - 4 * a * c;
-	if (d < 0.0f)
+	// Calculate discriminant (in double precision, b * b and 4 * a * c are often close)
+	double d = (double)b * b - 4 * (double)a * c;
+	if (d < 0.0)
 		return false;
 	
-	// Calculate solutions
-	float dSqrt = std::sqrt(d);
-	x1 = (- b + dSqrt) / (2 * a);
-	x2 = (- b - dSqrt) / (2 * a);
+	// Calculate solutions; the larger root never subtracts nearly equal values,
+	// and the smaller one follows from x1 * x2 = c / a (q is only zero for the double root at zero)
+	double dSqrt = std::sqrt(d);
+	double q = b < 0 ? -0.5 * (b - dSqrt) : -0.5 * (b + dSqrt);
+	x1 = q / a;
+	x2 = q != 0.0 ? c / q : x1;
 	
 	if (x1 > x2)
 		std::swap(x1, x2);
@@ -60,6 +70,56 @@ inline bool Quadratic(float a, float b, float c, float &x1, float &x2) {
 	return true;
 }
 
+// Floating-point error analysis
+// ==============================
+
+// Conservative bound on the relative error of n successive floating-point operations
+inline constexpr float Gamma(int n) {
+	return (n * MachineEpsilon) / (1 - n * MachineEpsilon);
+}
+
+// Reinterpret a float as its bit pattern and back
+inline uint32_t FloatToBits(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(float));
+	return bits;
+}
+
+inline float BitsToFloat(uint32_t bits) {
+	float f;
+	std::memcpy(&f, &bits, sizeof(uint32_t));
+	return f;
+}
+
+// Next representable float above/below v
+inline float NextFloatUp(float v) {
+	if (std::isinf(v) && v > 0.0f)
+		return v;
+	if (v == -0.0f)
+		v = 0.0f;
+
+	uint32_t bits = FloatToBits(v);
+	if (v >= 0)
+		bits++;
+	else
+		bits--;
+	return BitsToFloat(bits);
+}
+
+inline float NextFloatDown(float v) {
+	if (std::isinf(v) && v < 0.0f)
+		return v;
+	if (v == 0.0f)
+		v = -0.0f;
+
+	uint32_t bits = FloatToBits(v);
+	if (v > 0)
+		bits--;
+	else
+		bits++;
+	return BitsToFloat(bits);
+}
+
 // Linear interpolation
 inline float Lerp(float t, float x1, float x2) {
 	return x1 * (1 - t) + t * x2;
@@ -75,6 +135,15 @@ inline T Clamp(T n, U low, V high) {
 	return n;
 }
 
+// Square root and arccosine of arguments that may stray slightly outside their domain through rounding
+inline float SafeSqrt(float x) {
+	return std::sqrt(std::max(0.0f, x));
+}
+
+inline float SafeACos(float x) {
+	return std::acos(Clamp(x, -1.0f, 1.0f));
+}
+
 }
 
 #endif
@@ -0,0 +1,17 @@
+#include "bsdf.h"
+#include "sampling.h"
+
+namespace apollo {
+
+BSDF::BSDF(const Normal3f& n, float albedo) : ns(n), nz(n), albedo(albedo) {
+	CoordinateSystem(nz, &nx, &ny);
+}
+
+// Sample a cosine-weighted direction; for a diffuse surface f * cos / pdf reduces to the albedo
+Vector3f BSDF::Sample(const Point2f& u, float* weight) const {
+	Vector3f local = CosineSampleHemisphere(u);
+	*weight = albedo;
+	return nx * local.x + ny * local.y + nz * local.z;
+}
+
+}
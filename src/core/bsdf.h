@@ -0,0 +1,39 @@
+#ifndef APOLLO_CORE_BSDF_H
+#define APOLLO_CORE_BSDF_H
+
+#include "apollo.h"
+#include "vector3.h"
+#include "normal3.h"
+#include "point2.h"
+
+namespace apollo {
+
+// Scattering at a surface point; built per hit in the arena of the render thread
+// Only diffuse reflection is supported until materials are added
+class BSDF {
+	public:
+		// n is the shading normal, facing the side the ray arrived from
+		BSDF(const Normal3f& n, float albedo);
+
+		// Shading normal
+		const Normal3f& ShadingNormal() const { return ns; }
+
+		// Value of the BSDF for any pair of directions above the surface
+		float f() const { return albedo * InvPI; }
+
+		// Sample a cosine-weighted direction; weight is f * cos / pdf
+		Vector3f Sample(const Point2f& u, float* weight) const;
+
+		// Solid angle density of Sample returning the direction wi
+		float Pdf(const Vector3f& wi) const { return std::max(0.0f, Dot(wi, ns)) * InvPI; }
+
+	private:
+		Normal3f ns;
+		// Orthonormal shading frame around ns
+		Vector3f nx, ny, nz;
+		float albedo;
+};
+
+}
+
+#endif
@@ -5,11 +5,34 @@ namespace apollo {
 Film::Film(const Point2i& res) : resolution(res) {}
 
 RGB const & Film::GetPixel(const Point2i& position) const {
-	return pixels[position.x * resolution.x + position.y];
+	return pixels[position.y * resolution.x + position.x];
 }
 
 RGB& Film::GetPixel(const Point2i& position) {
-	return pixels[position.x * resolution.x + position.y];
+	return pixels[position.y * resolution.x + position.x];
+}
+
+const RGB* Film::GetPixels() const {
+	static_assert(sizeof(RGB) == 3 * sizeof(float), "RGB must be three packed floats");
+	return pixels.get();
+}
+
+// Per-pixel render cost AOV
+// =========================
+void Film::EnableCostAOV() {
+	costs.reset(new PixelCost[resolution.x * resolution.y]);
+}
+
+bool Film::HasCostAOV() const {
+	return costs != nullptr;
+}
+
+PixelCost const & Film::GetPixelCost(const Point2i& position) const {
+	return costs[position.y * resolution.x + position.x];
+}
+
+PixelCost& Film::GetPixelCost(const Point2i& position) {
+	return costs[position.y * resolution.x + position.x];
 }
 
 }
@@ -4,6 +4,7 @@
 #include "apollo.h"
 #include "point2.h"
 #include "rgb.h"
+#include "pixelcost.h"
 
 namespace apollo {
 
@@ -14,10 +15,21 @@ class Film {
 	
 		RGB const & GetPixel(const Point2i& position) const;
 		RGB& GetPixel(const Point2i& position);
+
+		// All pixels row by row; read as 3 * resolution.x * resolution.y packed floats by whole-image kernels
+		const RGB* GetPixels() const;
+
+		// Per-pixel render cost AOV (traversal steps, primitive tests and time)
+		// =======================================================================
+		void EnableCostAOV();
+		bool HasCostAOV() const;
+		PixelCost const & GetPixelCost(const Point2i& position) const;
+		PixelCost& GetPixelCost(const Point2i& position);
 	public:
 		const Point2i resolution;
 	private:
 		std::shared_ptr<RGB[]> pixels{new RGB[resolution.x * resolution.y]};
+		std::shared_ptr<PixelCost[]> costs;
 
 };
 
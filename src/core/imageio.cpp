@@ -1,22 +1,337 @@
 #include "apollo.h"
 #include "imageio.h"
+#include "stats.h"
+#include "trace.h"
+#include "parallel.h"
+#include <cstring>
+#include <cstdio>
+#include <cctype>
 
 namespace apollo {
 
+// Write film pixels in binary .ppm format, converted to 8 bits with the given tone mapping settings
+static void WritePPM(std::ostream& out, Film& film, const ToneMapSettings& settings) {
+	int width = film.resolution.x;
+	int height = film.resolution.y;
+
+	std::vector<uint8_t> bytes(3 * (size_t)width * height);
+	ToneMap(film, settings, bytes.data());
+
+	out << "P6\n" << width << " " << height << "\n255\n";
+	out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
 // Write film pixels to .ppm file
-bool WriteToPPM(Film& film) {
-	int width = film.resolution.x; // 400
-	int height = film.resolution.y; // 600
+bool WriteToPPM(Film& film, const ToneMapSettings& settings) {
+	STAT_PHASE(Write);
+	TRACE_SCOPE("Write PPM", "write");
+
+	WritePPM(std::cout, film, settings);
+	return (bool)std::cout;
+}
+
+bool WriteToPPM(Film& film, const std::string& filename, const ToneMapSettings& settings) {
+	STAT_PHASE(Write);
+	TRACE_SCOPE("Write PPM", "write");
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	WritePPM(out, film, settings);
+	return (bool)out;
+}
+
+// Per-pixel cost output
+// =====================
+
+// Value of a cost metric
+static float CostValue(const PixelCost& cost, CostMetric metric) {
+	switch (metric) {
+		case CostMetric::TraversalSteps:
+			return (float)cost.traversalSteps;
+		case CostMetric::PrimitiveTests:
+			return (float)cost.primitiveTests;
+		default:
+			return (float)cost.nanoseconds;
+	}
+}
+
+// Map t in [0, 1] to a blue-cyan-green-yellow-red color ramp
+static RGB FalseColor(float t) {
+	static const RGB ramp[] = { RGB(0, 0, 1), RGB(0, 1, 1), RGB(0, 1, 0), RGB(1, 1, 0), RGB(1, 0, 0) };
+	float x = Clamp(t, 0.0f, 1.0f) * 4;
+	int i = std::min((int)x, 3);
+	float f = x - i;
+	return ramp[i] * (1 - f) + ramp[i + 1] * f;
+}
+
+// Write a false-color image of a per-pixel cost metric to .ppm file
+bool WriteCostHeatmap(const Film& film, CostMetric metric, const std::string& filename) {
+	if (!film.HasCostAOV()) {
+		std::cerr << "Cost AOV is not enabled for the film" << std::endl;
+		return false;
+	}
+
+	const Point2i res = film.resolution;
+	std::vector<float> values;
+	values.reserve(res.x * res.y);
+	for (int y = 0; y < res.y; y++)
+		for (int x = 0; x < res.x; x++)
+			values.push_back(CostValue(film.GetPixelCost(Point2i(x, y)), metric));
+
+	// Normalize by the 99th percentile so a few outliers don't flatten the rest of the image
+	std::vector<float> sorted(values);
+	size_t k = (sorted.size() * 99) / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	float scale = sorted[k] > 0 ? 1.0f / sorted[k] : 0.0f;
+
+	Film heatmap(res);
+	for (int y = 0; y < res.y; y++)
+		for (int x = 0; x < res.x; x++)
+			heatmap.GetPixel(Point2i(x, y)) = FalseColor(values[y * res.x + x] * scale);
+
+	return WriteToPPM(heatmap, filename);
+}
+
+// Write the raw per-pixel costs to .pfm file
+bool WriteCostPFM(const Film& film, const std::string& filename) {
+	TRACE_SCOPE("Write PFM", "write");
+
+	if (!film.HasCostAOV()) {
+		std::cerr << "Cost AOV is not enabled for the film" << std::endl;
+		return false;
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	// A negative scale marks little-endian data; scanlines are stored from bottom to top
+	const Point2i res = film.resolution;
+	out << "PF\n" << res.x << " " << res.y << "\n-1\n";
+
+	std::vector<float> scanline(3 * res.x);
+	for (int y = res.y - 1; y >= 0; y--) {
+		for (int x = 0; x < res.x; x++) {
+			const PixelCost& cost = film.GetPixelCost(Point2i(x, y));
+			scanline[3 * x] = (float)cost.traversalSteps;
+			scanline[3 * x + 1] = (float)cost.primitiveTests;
+			scanline[3 * x + 2] = (float)cost.nanoseconds;
+		}
+		out.write(reinterpret_cast<const char*>(scanline.data()), scanline.size() * sizeof(float));
+	}
+
+	return (bool)out;
+}
+
+
+// Image input
+// ===========
+
+// Read a whole file into memory, so that its rows can be decoded in parallel
+static bool ReadFileBytes(const std::string& filename, std::vector<uint8_t>* bytes) {
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	if (!in) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	bytes->resize((size_t)in.tellg());
+	in.seekg(0);
+	in.read(reinterpret_cast<char*>(bytes->data()), bytes->size());
+	return (bool)in;
+}
+
+// Next whitespace separated token of a header, starting at *pos; leaves *pos on the character after it
+static std::string NextToken(const std::vector<uint8_t>& bytes, size_t* pos) {
+	while (*pos < bytes.size() && std::isspace(bytes[*pos]))
+		(*pos)++;
+	const size_t start = *pos;
+	while (*pos < bytes.size() && !std::isspace(bytes[*pos]))
+		(*pos)++;
+	return std::string(bytes.begin() + start, bytes.begin() + *pos);
+}
+
+// Next line of a header, without its newline
+static std::string NextLine(const std::vector<uint8_t>& bytes, size_t* pos) {
+	const size_t start = *pos;
+	while (*pos < bytes.size() && bytes[*pos] != '\n')
+		(*pos)++;
+	std::string line(bytes.begin() + start, bytes.begin() + *pos);
+	if (*pos < bytes.size())
+		(*pos)++;
+	return line;
+}
+
+// PFM stores 32-bit floats in the byte order given by the sign of the scale (negative for little-endian), with the
+// scanlines from bottom to top; "PF" images have three channels, "Pf" images one
+static bool ReadPFM(const std::string& filename, std::vector<RGB>* pixels, Point2i* resolution) {
+	std::vector<uint8_t> bytes;
+	if (!ReadFileBytes(filename, &bytes))
+		return false;
+
+	size_t pos = 0;
+	const std::string magic = NextToken(bytes, &pos);
+	const int nChannels = magic == "PF" ? 3 : magic == "Pf" ? 1 : 0;
+	const int width = std::atoi(NextToken(bytes, &pos).c_str());
+	const int height = std::atoi(NextToken(bytes, &pos).c_str());
+	const float scale = (float)std::atof(NextToken(bytes, &pos).c_str());
+	// A single whitespace character separates the header from the data
+	pos++;
+
+	if (nChannels == 0 || width <= 0 || height <= 0 || scale == 0.0f ||
+	    bytes.size() < pos + (size_t)nChannels * width * height * sizeof(float)) {
+		std::cerr << "Invalid PFM file " << filename << std::endl;
+		return false;
+	}
+
+	const uint32_t one = 1;
+	uint8_t firstByte;
+	std::memcpy(&firstByte, &one, 1);
+	const bool swapBytes = (scale < 0.0f) != (firstByte == 1);
+	const float absScale = std::abs(scale);
+
+	pixels->resize((size_t)width * height);
+	*resolution = Point2i(width, height);
+	ParallelFor([&](int64_t y) {
+		const uint8_t* row = &bytes[pos + (size_t)(height - 1 - y) * width * nChannels * sizeof(float)];
+		for (int x = 0; x < width; x++) {
+			float c[3];
+			for (int i = 0; i < nChannels; i++) {
+				uint32_t bits;
+				std::memcpy(&bits, row + (x * nChannels + i) * sizeof(float), sizeof(float));
+				if (swapBytes)
+					bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+				c[i] = BitsToFloat(bits) * absScale;
+			}
+			(*pixels)[y * width + x] = nChannels == 3 ? RGB(c[0], c[1], c[2]) : RGB(c[0]);
+		}
+	}, height, 16);
+	return true;
+}
+
+// Scanlines of Radiance files are either flat RGBE pixels or start with 2, 2 and their width, followed by every channel
+// run-length encoded on its own
+static bool IsRLEScanline(const std::vector<uint8_t>& bytes, size_t pos, int width) {
+	return width >= 8 && width < 32768 && pos + 4 <= bytes.size() && bytes[pos] == 2 && bytes[pos + 1] == 2 &&
+		((bytes[pos + 2] << 8) | bytes[pos + 3]) == width;
+}
 
-	std::cout << "P3\n" << width << " " << height << "\n255\n";
+// Radiance RGBE: a text header, a resolution line and the scanlines from top to bottom
+// Compressed scanlines have no fixed size, so a quick serial pass finds where each starts by skipping over the runs;
+// the rows are then decoded in parallel. Only the standard -Y +X orientation is supported
+static bool ReadHDR(const std::string& filename, std::vector<RGB>* pixels, Point2i* resolution) {
+	std::vector<uint8_t> bytes;
+	if (!ReadFileBytes(filename, &bytes))
+		return false;
 
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			std::cout << film.GetPixel(Point2i(i, j)) << '\n';
+	size_t pos = 0;
+	if (NextLine(bytes, &pos).compare(0, 2, "#?") != 0) {
+		std::cerr << "Invalid Radiance HDR file " << filename << std::endl;
+		return false;
+	}
+	for (std::string line = NextLine(bytes, &pos); !line.empty(); line = NextLine(bytes, &pos)) {
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+			std::cerr << "Unsupported Radiance HDR format " << line.substr(7) << " in " << filename << std::endl;
+			return false;
 		}
 	}
 
+	int width = 0, height = 0;
+	if (std::sscanf(NextLine(bytes, &pos).c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+		std::cerr << "Unsupported Radiance HDR resolution in " << filename << std::endl;
+		return false;
+	}
+
+	// Locate the scanlines and validate all run lengths, so that decoding needs no further checks
+	std::vector<size_t> rowStart(height);
+	for (int y = 0; y < height; y++) {
+		rowStart[y] = pos;
+		if (IsRLEScanline(bytes, pos, width)) {
+			pos += 4;
+			for (int c = 0; c < 4; c++) {
+				for (int x = 0; x < width; ) {
+					int count = pos < bytes.size() ? bytes[pos++] : 0;
+					if (count > 128) {
+						count -= 128;
+						pos++;
+					} else
+						pos += count;
+					x += count;
+					if (count == 0 || x > width || pos > bytes.size()) {
+						std::cerr << "Corrupt scanline " << y << " in " << filename << std::endl;
+						return false;
+					}
+				}
+			}
+		} else {
+			pos += 4 * (size_t)width;
+			if (pos > bytes.size()) {
+				std::cerr << "Truncated Radiance HDR file " << filename << std::endl;
+				return false;
+			}
+		}
+	}
+
+	pixels->resize((size_t)width * height);
+	*resolution = Point2i(width, height);
+	ParallelFor([&](int64_t y) {
+		std::vector<uint8_t> rgbe(4 * (size_t)width);
+		size_t p = rowStart[y];
+		if (IsRLEScanline(bytes, p, width)) {
+			p += 4;
+			for (int c = 0; c < 4; c++) {
+				for (int x = 0; x < width; ) {
+					int count = bytes[p++];
+					if (count > 128) {
+						count -= 128;
+						const uint8_t value = bytes[p++];
+						for (int i = 0; i < count; i++)
+							rgbe[4 * (x + i) + c] = value;
+					} else {
+						for (int i = 0; i < count; i++)
+							rgbe[4 * (x + i) + c] = bytes[p++];
+					}
+					x += count;
+				}
+			}
+		} else
+			std::memcpy(rgbe.data(), &bytes[p], rgbe.size());
+
+		// The shared exponent scales the three 8-bit mantissas (rounded to the centers of their intervals)
+		for (int x = 0; x < width; x++) {
+			const uint8_t* e = &rgbe[4 * x];
+			RGB& pixel = (*pixels)[y * width + x];
+			if (e[3] == 0)
+				pixel = RGB(0.0f);
+			else {
+				const float f = std::ldexp(1.0f, e[3] - (128 + 8));
+				pixel = RGB((e[0] + 0.5f) * f, (e[1] + 0.5f) * f, (e[2] + 0.5f) * f);
+			}
+		}
+	}, height, 16);
 	return true;
 }
 
+// Read a high dynamic range image, choosing the format by the file extension
+bool ReadImage(const std::string& filename, std::vector<RGB>* pixels, Point2i* resolution) {
+	STAT_PHASE(Load);
+	TRACE_SCOPE("Read image", "load");
+
+	std::string extension = filename.substr(std::min(filename.size(), filename.find_last_of('.') + 1));
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower(c); });
+	if (extension == "pfm")
+		return ReadPFM(filename, pixels, resolution);
+	if (extension == "hdr")
+		return ReadHDR(filename, pixels, resolution);
+
+	std::cerr << "Unsupported image format of " << filename << std::endl;
+	return false;
+}
+
 }
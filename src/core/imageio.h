@@ -3,11 +3,28 @@
 
 #include "apollo.h"
 #include "film.h"
+#include "tonemap.h"
 
 namespace apollo {
 
-// Write film pixels to .ppm file
-bool WriteToPPM(Film& film);
+// Write film pixels to binary .ppm file (stdout if no filename is given)
+// The default settings clamp the linear values to [0, 1] without any encoding
+bool WriteToPPM(Film& film, const ToneMapSettings& settings = ToneMapSettings());
+bool WriteToPPM(Film& film, const std::string& filename, const ToneMapSettings& settings = ToneMapSettings());
+
+// Read a high dynamic range image from .pfm or .hdr (Radiance RGBE) file
+// The pixels are stored row by row from the top of the image; conversion and decoding of the rows run on all cores
+bool ReadImage(const std::string& filename, std::vector<RGB>* pixels, Point2i* resolution);
+
+// Per-pixel cost shown by the cost heatmap
+enum class CostMetric { TraversalSteps, PrimitiveTests, Time };
+
+// Write a false-color image of a per-pixel cost metric to .ppm file (blue is cheap, red is expensive)
+// Requires the cost AOV of the film to be enabled
+bool WriteCostHeatmap(const Film& film, CostMetric metric, const std::string& filename);
+
+// Write the raw per-pixel costs to .pfm file (channels: traversal steps, primitive tests, nanoseconds)
+bool WriteCostPFM(const Film& film, const std::string& filename);
 
 }
 
@@ -1,9 +1,151 @@
 #include "apollo.h"
 #include "light.h"
+#include "transformcache.h"
 
 namespace apollo {
 
+// Light Bounds
+// ============
+
+// Cosine of max(0, a - b) for angles a and b given by their sines and cosines, and the matching sine
+static inline float CosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+static inline float SinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+// Cosine of the half angle of the cone around the direction from p to the center of b that contains b
+static float BoundSubtendedCos(const Bounds3f& b, const Point3f& p) {
+	const Point3f center = b.pMin * 0.5f + b.pMax * 0.5f;
+	const float radius2 = (b.pMax - center).LengthSquared();
+	const float d2 = (p - center).LengthSquared();
+	// Points inside the bounding sphere see it in all directions
+	if (d2 <= radius2)
+		return -1.0f;
+	return SafeSqrt(1 - radius2 / d2);
+}
+
+// The angle between the emission direction and the direction to p is reduced by the spread of the orientation cone and
+// the angle the bounds subtend, which gives the most favorable emission angle any light inside can have; the angle at
+// the surface is reduced the same way. Surfaces only reflect, so lights behind the normal do not count
+float LightBounds::Importance(const Point3f& p, const Normal3f& n) const {
+	const Point3f pc = Centroid();
+	Vector3f wi = p - pc;
+	const float dist = wi.Length();
+	if (dist == 0.0f)
+		return 0.0f;
+	wi /= dist;
+
+	// Keep the falloff bounded for points close to or inside large bounds
+	const float d2 = std::max(dist * dist, bounds.Diagonal().Length() / 2);
+
+	float cosTheta_w = Dot(w, wi);
+	if (twoSided)
+		cosTheta_w = std::abs(cosTheta_w);
+	const float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+	const float cosTheta_b = BoundSubtendedCos(bounds, p);
+	const float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+	// Smallest angle between an emission direction in the orientation cone and a direction towards p
+	const float sinTheta_o = SafeSqrt(1 - cosTheta_o * cosTheta_o);
+	const float cosTheta_x = CosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+	const float sinTheta_x = SinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+	const float cosThetap = CosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+	if (cosThetap <= cosTheta_e)
+		return 0.0f;
+
+	float importance = phi * cosThetap / d2;
+
+	if (n.x != 0.0f || n.y != 0.0f || n.z != 0.0f) {
+		const float cosTheta_i = -Dot(wi, n);
+		const float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+		importance *= CosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+	}
+
+	return std::max(importance, 0.0f);
+}
+
+// Rotate v by theta around the unit axis
+static Vector3f RotateAround(const Vector3f& v, const Vector3f& axis, float theta) {
+	const float cosTheta = std::cos(theta), sinTheta = std::sin(theta);
+	return v * cosTheta + Cross(axis, v) * sinTheta + axis * (Dot(axis, v) * (1 - cosTheta));
+}
+
+// Smallest cone containing the cones around wa and wb with half angle cosines cosA and cosB
+static void UnionCones(const Vector3f& wa, float cosA, const Vector3f& wb, float cosB, Vector3f* w, float* cosTheta) {
+	const float thetaA = SafeACos(cosA), thetaB = SafeACos(cosB);
+	const float thetaD = SafeACos(Dot(wa, wb));
+
+	// One cone contains the other
+	if (std::min(thetaD + thetaB, PI) <= thetaA) {
+		*w = wa;
+		*cosTheta = cosA;
+		return;
+	}
+	if (std::min(thetaD + thetaA, PI) <= thetaB) {
+		*w = wb;
+		*cosTheta = cosB;
+		return;
+	}
+
+	// The merged cone spans from the far side of one cone to the far side of the other
+	const float thetaO = (thetaA + thetaD + thetaB) / 2;
+	const Vector3f axis = Cross(wa, wb);
+	if (thetaO >= PI || axis.LengthSquared() == 0.0f) {
+		*w = wa;
+		*cosTheta = -1.0f;
+		return;
+	}
+
+	*w = RotateAround(wa, axis.Normalized(), thetaO - thetaA);
+	*cosTheta = std::cos(thetaO);
+}
+
+// Bounds of the lights of both a and b
+LightBounds Union(const LightBounds& a, const LightBounds& b) {
+	if (a.phi == 0.0f)
+		return b;
+	if (b.phi == 0.0f)
+		return a;
+
+	Vector3f w;
+	float cosTheta_o;
+	UnionCones(a.w, a.cosTheta_o, b.w, b.cosTheta_o, &w, &cosTheta_o);
+	return LightBounds(Union(a.bounds, b.bounds), w, a.phi + b.phi, cosTheta_o, std::min(a.cosTheta_e, b.cosTheta_e),
+		a.twoSided || b.twoSided);
+}
+
+// Point Light
+// ===========
+
 Light::Light(const Transform* lightToWorld, const Transform* worldToLight, const RGB& color, const float intensity) 
 	: lightToWorld(lightToWorld), worldToLight(worldToLight), color(color), intensity(intensity) {}
 
-}
\ No newline at end of file
+std::shared_ptr<Light> CreateLight(const Transform& lightToWorld, const RGB& color, float intensity) {
+	const Transform *toWorld, *toLight;
+	transformCache.Lookup(lightToWorld, &toWorld, &toLight);
+	return std::make_shared<Light>(toWorld, toLight, color, intensity);
+}
+
+// Power emitted over all directions, bounded over the color channels
+float Light::Phi() const {
+	return 4 * PI * intensity * color.MaxComponent();
+}
+
+// Bounds of the light's position and emission
+LightBounds Light::Bounds() const {
+	const Point3f p = (*lightToWorld)(Point3f(0.0f));
+	// Emission covers the whole sphere of directions, so the orientation cone does too and the emission cone adds nothing
+	return LightBounds(Bounds3f(p), Vector3f(0.0f, 0.0f, 1.0f), Phi(), -1.0f, 0.0f, false);
+}
+
+// Upsampled color used by spectral rendering
+const RGBUnboundedSpectrum& Light::GetSpectrum() const {
+	std::call_once(spectrumFlag, [this]() { spectrum.reset(new RGBUnboundedSpectrum(color)); });
+	return *spectrum;
+}
+
+}
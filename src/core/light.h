@@ -4,19 +4,61 @@
 #include "apollo.h"
 #include "transform.h"
 #include "rgb.h"
+#include "spectrum.h"
+#include <mutex>
 
 namespace apollo {
 
+// Bounds on where one or more lights are and in which directions they emit
+// Emission leaves within cosTheta_o of the direction w (the orientation cone) and from there spreads up to cosTheta_e
+// further (the emission cone); phi bounds the emitted power
+struct LightBounds {
+	LightBounds() = default;
+	LightBounds(const Bounds3f& bounds, const Vector3f& w, float phi, float cosTheta_o, float cosTheta_e, bool twoSided)
+		: bounds(bounds), w(w), phi(phi), cosTheta_o(cosTheta_o), cosTheta_e(cosTheta_e), twoSided(twoSided) {}
+
+	Point3f Centroid() const { return bounds.pMin * 0.5f + bounds.pMax * 0.5f; }
+
+	// Conservative estimate of the light arriving at point p on a surface facing n (a zero n for points not on a surface)
+	float Importance(const Point3f& p, const Normal3f& n) const;
+
+	Bounds3f bounds;
+	Vector3f w;
+	float phi = 0.0f;
+	float cosTheta_o = 1.0f, cosTheta_e = 1.0f;
+	bool twoSided = false;
+};
+
+// Bounds of the lights of both a and b
+LightBounds Union(const LightBounds& a, const LightBounds& b);
+
+// Point light emitting uniformly in all directions
 class Light {
 public:
 	Light(const Transform* lightToWorld, const Transform* worldToLight, const RGB& color, const float intensity);
 
+	// Power emitted over all directions, bounded over the color channels
+	float Phi() const;
+
+	// Bounds of the light's position and emission
+	LightBounds Bounds() const;
+
+	// Upsampled color used by spectral rendering; built on first use, so RGB renders never fit the spectrum table
+	const RGBUnboundedSpectrum& GetSpectrum() const;
+
 public:
 	const Transform *lightToWorld, *worldToLight;
-	const RGB& color;
+	const RGB color;
 	const float intensity;
+
+private:
+	mutable std::once_flag spectrumFlag;
+	mutable std::unique_ptr<RGBUnboundedSpectrum> spectrum;
 };
 
+// Point light whose transform and its inverse are shared through the transform cache
+std::shared_ptr<Light> CreateLight(const Transform& lightToWorld, const RGB& color, float intensity);
+
 }
 
 #endif
@@ -0,0 +1,77 @@
+#include "memory.h"
+#include <cstdlib>
+
+namespace apollo {
+
+// Allocate memory aligned to a cache line
+void* AllocAligned(size_t size) {
+	// aligned_alloc requires the size to be a multiple of the alignment
+	size = (size + CacheLineSize - 1) & ~(CacheLineSize - 1);
+	return std::aligned_alloc(CacheLineSize, size);
+}
+
+void FreeAligned(void* ptr) {
+	std::free(ptr);
+}
+
+MemoryArena::MemoryArena(size_t blockSize) : blockSize(blockSize) {}
+
+MemoryArena::~MemoryArena() {
+	FreeAligned(currentBlock);
+	for (auto& block : usedBlocks)
+		FreeAligned(block.second);
+	for (auto& block : availableBlocks)
+		FreeAligned(block.second);
+}
+
+// Allocate nBytes from the current block, moving on to a new block when it is full
+void* MemoryArena::Alloc(size_t nBytes) {
+	const size_t align = 16;
+	nBytes = (nBytes + align - 1) & ~(align - 1);
+
+	if (currentBlockPos + nBytes > currentAllocSize) {
+		if (currentBlock) {
+			usedBlocks.push_back(std::make_pair(currentAllocSize, currentBlock));
+			currentBlock = nullptr;
+			currentAllocSize = 0;
+		}
+
+		// Reuse a block freed by Reset() if one is large enough
+		for (auto it = availableBlocks.begin(); it != availableBlocks.end(); ++it) {
+			if (it->first >= nBytes) {
+				currentAllocSize = it->first;
+				currentBlock = it->second;
+				availableBlocks.erase(it);
+				break;
+			}
+		}
+
+		if (!currentBlock) {
+			currentAllocSize = std::max(nBytes, blockSize);
+			currentBlock = static_cast<uint8_t*>(AllocAligned(currentAllocSize));
+		}
+		currentBlockPos = 0;
+	}
+
+	void* result = currentBlock + currentBlockPos;
+	currentBlockPos += nBytes;
+	return result;
+}
+
+// Make all allocated memory available again
+void MemoryArena::Reset() {
+	currentBlockPos = 0;
+	availableBlocks.splice(availableBlocks.begin(), usedBlocks);
+}
+
+// Bytes held by the arena
+size_t MemoryArena::TotalAllocated() const {
+	size_t total = currentAllocSize;
+	for (const auto& block : usedBlocks)
+		total += block.first;
+	for (const auto& block : availableBlocks)
+		total += block.first;
+	return total;
+}
+
+}
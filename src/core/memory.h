@@ -0,0 +1,65 @@
+#ifndef APOLLO_CORE_MEMORY_H
+#define APOLLO_CORE_MEMORY_H
+
+#include "apollo.h"
+#include <list>
+
+namespace apollo {
+
+// Size of a cache line; arena blocks are aligned to it
+static constexpr size_t CacheLineSize = 64;
+
+// Allocate and free memory aligned to a cache line
+void* AllocAligned(size_t size);
+void FreeAligned(void* ptr);
+
+// Bump allocator for short-lived objects
+// ======================================
+// Allocations are carved out of large blocks and are never freed one by one; Reset() makes all of them available again at once.
+// Destructors are not run, so only objects that need no destruction should be placed in an arena.
+// Allocations within a block are only aligned to 16 bytes, which suits the small shading objects placed in arenas.
+// An arena is not thread safe: every render thread uses its own, found by its ThreadIndex. A nested ParallelFor gives
+// its new threads the indices 1..n-1 again, so arenas indexed this way must not be used inside a nested ParallelFor.
+class alignas(CacheLineSize) MemoryArena {
+	public:
+		MemoryArena(size_t blockSize = 262144);
+		~MemoryArena();
+
+		MemoryArena(const MemoryArena&) = delete;
+		MemoryArena& operator=(const MemoryArena&) = delete;
+
+		// Allocate nBytes (rounded up to 16 bytes)
+		void* Alloc(size_t nBytes);
+
+		// Allocate an array of n default constructed T
+		template <typename T>
+		T* Alloc(size_t n = 1) {
+			T* result = static_cast<T*>(Alloc(n * sizeof(T)));
+			for (size_t i = 0; i < n; i++)
+				new (&result[i]) T();
+			return result;
+		}
+
+		// Allocate a single T constructed from args
+		template <typename T, typename... Args>
+		T* Create(Args&&... args) {
+			return new (Alloc(sizeof(T))) T(std::forward<Args>(args)...);
+		}
+
+		// Make all allocated memory available again; the blocks are kept for reuse
+		void Reset();
+
+		// Bytes held by the arena
+		size_t TotalAllocated() const;
+
+	private:
+		const size_t blockSize;
+		size_t currentBlockPos = 0, currentAllocSize = 0;
+		uint8_t* currentBlock = nullptr;
+		// Filled blocks and blocks freed by Reset(), with their sizes
+		std::list<std::pair<size_t, uint8_t*>> usedBlocks, availableBlocks;
+};
+
+}
+
+#endif
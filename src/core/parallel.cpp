@@ -0,0 +1,64 @@
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+#include <thread>
+#include <atomic>
+
+namespace apollo {
+
+thread_local int ThreadIndex = 0;
+
+// Number of hardware threads available for rendering
+int NumSystemCores() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Execute func(i) for every i in [0, count) on all cores
+void ParallelFor(const std::function<void(int64_t)>& func, int64_t count, int chunkSize) {
+	int64_t nChunks = (count + chunkSize - 1) / chunkSize;
+	int nThreads = (int)std::min<int64_t>(NumSystemCores(), nChunks);
+
+	// Run serially when there is not enough work to share
+	if (nThreads <= 1) {
+		for (int64_t i = 0; i < count; i++)
+			func(i);
+		return;
+	}
+
+	// Every thread keeps grabbing the next unprocessed chunk until none are left
+	std::atomic<int64_t> nextChunk{0};
+	auto worker = [&]() {
+		TRACE_SCOPE("ParallelFor", "parallel");
+		for (int64_t chunk = nextChunk++; chunk < nChunks; chunk = nextChunk++) {
+			int64_t start = chunk * chunkSize;
+			int64_t end = std::min(start + chunkSize, count);
+			for (int64_t i = start; i < end; i++)
+				func(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(nThreads - 1);
+	for (int t = 1; t < nThreads; t++)
+		threads.emplace_back([&worker, t]() {
+			ThreadIndex = t;
+			worker();
+			MergeThreadStats();
+			FlushThreadTrace();
+		});
+
+	// The calling thread takes part in the work as well
+	worker();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+// Execute func(p) for every p in [0, count.x) x [0, count.y) on all cores
+void ParallelFor2D(const std::function<void(Point2i)>& func, const Point2i& count) {
+	ParallelFor([&](int64_t i) {
+		func(Point2i((int)(i % count.x), (int)(i / count.x)));
+	}, (int64_t)count.x * count.y);
+}
+
+}
@@ -0,0 +1,26 @@
+#ifndef APOLLO_CORE_PARALLEL_H
+#define APOLLO_CORE_PARALLEL_H
+
+#include "apollo.h"
+#include "point2.h"
+#include <functional>
+#include <cstdint>
+
+namespace apollo {
+
+// Index of the calling render thread (0 for the main thread)
+extern thread_local int ThreadIndex;
+
+// Number of hardware threads available for rendering
+int NumSystemCores();
+
+// Execute func(i) for every i in [0, count) on all cores
+// Iterations are handed out to the threads in chunks of chunkSize
+void ParallelFor(const std::function<void(int64_t)>& func, int64_t count, int chunkSize = 1);
+
+// Execute func(p) for every p in [0, count.x) x [0, count.y) on all cores
+void ParallelFor2D(const std::function<void(Point2i)>& func, const Point2i& count);
+
+}
+
+#endif
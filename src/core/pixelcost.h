@@ -0,0 +1,58 @@
+#ifndef APOLLO_CORE_PIXELCOST_H
+#define APOLLO_CORE_PIXELCOST_H
+
+#include "apollo.h"
+#include <cstdint>
+#include <chrono>
+
+namespace apollo {
+
+// Render cost of a single pixel, recorded by the cost AOV of the film
+struct PixelCost {
+	PixelCost& operator+=(const PixelCost& c) {
+		traversalSteps += c.traversalSteps;
+		primitiveTests += c.primitiveTests;
+		nanoseconds += c.nanoseconds;
+		return *this;
+	}
+
+	// BVH nodes visited
+	uint64_t traversalSteps = 0;
+	// Ray-primitive intersection tests
+	uint64_t primitiveTests = 0;
+	// Wall-clock time
+	uint64_t nanoseconds = 0;
+};
+
+// Cost record the calling thread currently charges its work to (nullptr when no cost is recorded)
+inline thread_local PixelCost* activePixelCost = nullptr;
+
+#define COST_INC(field) do { if (apollo::activePixelCost) apollo::activePixelCost->field++; } while (0)
+
+// Charge all work and time until the end of the enclosing scope to the given cost record (nullptr records nothing)
+class PixelCostScope {
+	public:
+		PixelCostScope(PixelCost* cost) : cost(cost), previous(activePixelCost) {
+			if (cost) {
+				start = std::chrono::steady_clock::now();
+				activePixelCost = cost;
+			}
+		}
+
+		~PixelCostScope() {
+			if (cost) {
+				auto elapsed = std::chrono::steady_clock::now() - start;
+				cost->nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+				activePixelCost = previous;
+			}
+		}
+
+	private:
+		PixelCost* const cost;
+		PixelCost* const previous;
+		std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#endif
@@ -1,26 +1,51 @@
 #include "primitive.h"
+#include "transform.h"
 
 namespace apollo {
 
 // Primitive Definitions
 // =====================
 
-Primitive::Primitive(const Shape* shape) : shape(shape) {}
+Primitive::Primitive(const Shape* shape, const AnimatedTransform* primitiveToWorld) : shape(shape), primitiveToWorld(primitiveToWorld) {}
 
 // Get the axis aligned bounding box of the primitive in world space
 Bounds3f Primitive::WorldBound() {
+	if (primitiveToWorld)
+		return primitiveToWorld->MotionBounds(shape->WorldBound());
 	return shape->WorldBound();
 }
 
-// Get the intersection between the ray and the primitive
-bool Primitive::Intersect(const Ray &r, SurfaceInteraction *surf) {
-	bool intersection = shape->Intersect(r, surf);
-	if (intersection && surf) {
-		surf->primitive = this;
-		return true;
-	}
+// Get world space bounding boxes at time0 and time1 whose linear interpolation bounds the primitive in between
+void Primitive::LinearWorldBounds(float time0, float time1, Bounds3f* b0, Bounds3f* b1) {
+	if (primitiveToWorld)
+		primitiveToWorld->LinearMotionBounds(shape->WorldBound(), time0, time1, b0, b1);
+	else
+		*b0 = *b1 = shape->WorldBound();
+}
+
+// Check if the primitive moves
+bool Primitive::IsAnimated() const {
+	return primitiveToWorld && primitiveToWorld->IsAnimated();
+}
 
-	return intersection;
+// Intersect the shape at the ray's time; the transformed ray keeps its parametrization, so t carries over to world space
+bool Primitive::IntersectHit(const Ray &r, HitRecord *hit) const {
+	if (!primitiveToWorld)
+		return shape->IntersectHit(r, hit);
+	return shape->IntersectHit(primitiveToWorld->Interpolate(r.time).Inverse()(r), hit);
+}
+
+// Build the surface interaction for a hit recorded by IntersectHit
+SurfaceInteraction Primitive::ComputeSurfaceInteraction(const Ray &r, const HitRecord &hit) const {
+	SurfaceInteraction surf;
+	if (!primitiveToWorld)
+		surf = shape->ComputeSurfaceInteraction(r, hit);
+	else {
+		const Transform t = primitiveToWorld->Interpolate(r.time);
+		surf = t(shape->ComputeSurfaceInteraction(t.Inverse()(r), hit));
+	}
+	surf.primitive = this;
+	return surf;
 }
 
 // Get the surface area of the primitive
@@ -28,4 +53,34 @@ float Primitive::Area() {
 	return shape->Area();
 }
 
+// Primitive pool
+// ==============
+
+// Primitives of a scene with the owners of their shapes
+struct PrimitiveBlock {
+	std::vector<Primitive> primitives;
+	std::vector<std::shared_ptr<const void>> shapeOwners;
+};
+
+// Create a primitive for every shape, all in one contiguous allocation
+std::vector<std::shared_ptr<Primitive>> CreatePrimitives(const std::vector<std::shared_ptr<Shape>>& shapes,
+	const AnimatedTransform* primitiveToWorld) {
+	std::shared_ptr<PrimitiveBlock> block = std::make_shared<PrimitiveBlock>();
+	block->primitives.reserve(shapes.size());
+	for (size_t i = 0; i < shapes.size(); i++) {
+		block->primitives.emplace_back(shapes[i].get(), primitiveToWorld);
+
+		// Shapes from one mesh share an owner, so keeping one reference per run of equal owners is enough
+		const bool sameOwner = i > 0 && !shapes[i].owner_before(shapes[i - 1]) && !shapes[i - 1].owner_before(shapes[i]);
+		if (!sameOwner)
+			block->shapeOwners.push_back(shapes[i]);
+	}
+
+	std::vector<std::shared_ptr<Primitive>> primitives;
+	primitives.reserve(shapes.size());
+	for (Primitive& primitive : block->primitives)
+		primitives.push_back(std::shared_ptr<Primitive>(block, &primitive));
+	return primitives;
+}
+
 }
@@ -10,23 +10,42 @@
 namespace apollo {
 
 // A primitive is a spatial data structure. Many different shapes and materials can be attached to it
+// A moving primitive places its shape with an animated transform: the shape stays put in primitive space, and rays are
+// brought into that space at their own time
 class Primitive {
 	public:
-		Primitive(const Shape* shape);
+		Primitive(const Shape* shape, const AnimatedTransform* primitiveToWorld = nullptr);
 
-		// Get the axis aligned bounding box of the primitive in world space
+		// Get the axis aligned bounding box of the primitive in world space (over the whole motion of moving primitives)
 		Bounds3f WorldBound();
+
+		// Get world space bounding boxes at time0 and time1 whose linear interpolation bounds the primitive at every time in between
+		void LinearWorldBounds(float time0, float time1, Bounds3f* b0, Bounds3f* b1);
+
+		// Check if the primitive moves
+		bool IsAnimated() const;
 		
-		// Get the intersection between the ray and the primitive
-		bool Intersect(const Ray &r, SurfaceInteraction *surf = nullptr);
+		// Intersect the shape at the ray's time, filling in the hit record but neither the primitive nor the ray extent
+		bool IntersectHit(const Ray &r, HitRecord *hit) const;
+
+		// Build the surface interaction for a hit recorded by IntersectHit
+		SurfaceInteraction ComputeSurfaceInteraction(const Ray &r, const HitRecord &hit) const;
 		
 		// Get the surface area of the primitive
 		float Area(); 
 	public:
 		// The shape attached to the primitive
 		const Shape* shape;
+		// Motion of the primitive (nullptr for primitives whose shape is already in world space)
+		const AnimatedTransform* primitiveToWorld;
 };
 
+// Create a primitive for every shape, all in one contiguous allocation
+// The returned pointers share ownership of that allocation, which also keeps the shapes alive; everything is released
+// at once when the last of them goes away. All primitives move with primitiveToWorld if it is given, which must outlive them
+std::vector<std::shared_ptr<Primitive>> CreatePrimitives(const std::vector<std::shared_ptr<Shape>>& shapes,
+	const AnimatedTransform* primitiveToWorld = nullptr);
+
 }
 
 #endif
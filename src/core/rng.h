@@ -0,0 +1,55 @@
+#ifndef APOLLO_CORE_RNG_H
+#define APOLLO_CORE_RNG_H
+
+#include "apollo.h"
+#include <cstdint>
+
+namespace apollo {
+
+// Largest float strictly less than one
+static constexpr float OneMinusEpsilon = 0x1.fffffep-1;
+
+// PCG32 pseudo-random number generator (http://www.pcg-random.org)
+// Independent streams are selected through the sequence index, so every pixel sample
+// can own a deterministic generator without any shared state between threads
+class RNG {
+	public:
+		RNG() : state(DefaultState), inc(DefaultStream) {}
+		RNG(uint64_t sequenceIndex) {
+			SetSequence(sequenceIndex);
+		}
+
+		// Select the stream of random numbers
+		void SetSequence(uint64_t sequenceIndex) {
+			state = 0u;
+			inc = (sequenceIndex << 1u) | 1u;
+			UniformUInt32();
+			state += DefaultState;
+			UniformUInt32();
+		}
+
+		// Uniformly distributed 32-bit integer
+		uint32_t UniformUInt32() {
+			uint64_t oldState = state;
+			state = oldState * Multiplier + inc;
+			uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+			uint32_t rot = (uint32_t)(oldState >> 59u);
+			return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+		}
+
+		// Uniformly distributed float in [0, 1)
+		float UniformFloat() {
+			return std::min(OneMinusEpsilon, UniformUInt32() * 0x1p-32f);
+		}
+
+	private:
+		static constexpr uint64_t DefaultState = 0x853c49e6748fea9bULL;
+		static constexpr uint64_t DefaultStream = 0xda3e39cb94b95bdbULL;
+		static constexpr uint64_t Multiplier = 0x5851f42d4c957f2dULL;
+
+		uint64_t state, inc;
+};
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "sampling.h"
+#include "parallel.h"
+
+namespace apollo {
+
+// Piecewise-Constant Distributions
+// ================================
+
+Distribution1D::Distribution1D(const float* f, int n) : func(f, f + n), cdf(n + 1) {
+	// Accumulate in double precision; large rows would otherwise lose the contribution of small values
+	double sum = 0.0;
+	cdf[0] = 0.0f;
+	for (int i = 0; i < n; i++) {
+		sum += func[i];
+		cdf[i + 1] = (float)sum;
+	}
+	funcInt = (float)(sum / n);
+
+	if (sum == 0.0) {
+		for (int i = 1; i <= n; i++)
+			cdf[i] = (float)i / n;
+	} else {
+		for (int i = 1; i <= n; i++)
+			cdf[i] = (float)(cdf[i] / sum);
+	}
+	cdf[n] = 1.0f;
+}
+
+// Find the segment whose CDF interval contains u and place the sample linearly within it
+float Distribution1D::SampleContinuous(float u, float* pdf, int* offset) const {
+	const int n = Count();
+	const int index = Clamp((int)(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1, 0, n - 1);
+	if (offset)
+		*offset = index;
+
+	float du = u - cdf[index];
+	if (cdf[index + 1] - cdf[index] > 0.0f)
+		du /= cdf[index + 1] - cdf[index];
+
+	*pdf = funcInt > 0.0f ? func[index] / funcInt : 1.0f;
+	return std::min((index + du) / n, OneMinusEpsilon);
+}
+
+Distribution2D::Distribution2D(const float* func, int nu, int nv) : pConditionalV(nv) {
+	ParallelFor([&](int64_t v) {
+		pConditionalV[v].reset(new Distribution1D(&func[v * nu], nu));
+	}, nv, 16);
+
+	std::vector<float> marginalFunc(nv);
+	for (int v = 0; v < nv; v++)
+		marginalFunc[v] = pConditionalV[v]->funcInt;
+	pMarginal.reset(new Distribution1D(marginalFunc.data(), nv));
+}
+
+Point2f Distribution2D::SampleContinuous(const Point2f& u, float* pdf) const {
+	float pdfs[2];
+	int v;
+	const float d1 = pMarginal->SampleContinuous(u.y, &pdfs[1], &v);
+	const float d0 = pConditionalV[v]->SampleContinuous(u.x, &pdfs[0]);
+	*pdf = pdfs[0] * pdfs[1];
+	return Point2f(d0, d1);
+}
+
+// The product of the marginal and conditional densities reduces to the function value over its integral
+float Distribution2D::Pdf(const Point2f& p) const {
+	const int iu = Clamp((int)(p.x * pConditionalV[0]->Count()), 0, pConditionalV[0]->Count() - 1);
+	const int iv = Clamp((int)(p.y * pMarginal->Count()), 0, pMarginal->Count() - 1);
+	if (pMarginal->funcInt == 0.0f)
+		return 1.0f;
+	return pConditionalV[iv]->func[iu] / pMarginal->funcInt;
+}
+
+// Alias Table
+// ===========
+
+// Vose's construction: bins under the average weight are paired with bins over it, which donate the difference and
+// are requeued with what they have left. Every bin is finished in one step, so the construction is O(N)
+AliasTable::AliasTable(const std::vector<float>& weights) : bins(weights.size()) {
+	double sum = 0.0;
+	for (float w : weights)
+		sum += w;
+	// Without any weight to go by, fall back to choosing uniformly
+	for (size_t i = 0; i < weights.size(); i++)
+		bins[i].p = sum > 0.0 ? (float)(weights[i] / sum) : 1.0f / weights.size();
+
+	// Probabilities relative to the average, so that a full bin is worth one
+	struct Outcome {
+		double pHat;
+		int index;
+	};
+	std::vector<Outcome> under, over;
+	for (size_t i = 0; i < bins.size(); i++) {
+		const double pHat = (double)bins[i].p * bins.size();
+		if (pHat < 1.0)
+			under.push_back({ pHat, (int)i });
+		else
+			over.push_back({ pHat, (int)i });
+	}
+
+	while (!under.empty() && !over.empty()) {
+		const Outcome un = under.back(), ov = over.back();
+		under.pop_back();
+		over.pop_back();
+
+		bins[un.index].q = (float)un.pHat;
+		bins[un.index].alias = ov.index;
+
+		const double pExcess = un.pHat + ov.pHat - 1.0;
+		if (pExcess < 1.0)
+			under.push_back({ pExcess, ov.index });
+		else
+			over.push_back({ pExcess, ov.index });
+	}
+
+	// Whatever is left only differs from one by rounding error
+	while (!over.empty()) {
+		bins[over.back().index].q = 1.0f;
+		bins[over.back().index].alias = -1;
+		over.pop_back();
+	}
+	while (!under.empty()) {
+		bins[under.back().index].q = 1.0f;
+		bins[under.back().index].alias = -1;
+		under.pop_back();
+	}
+}
+
+// The integer part of u * N picks the bin and the fractional part decides between the bin and its alias
+int AliasTable::Sample(float u, float* pmf, float* uRemapped) const {
+	const float scaled = u * bins.size();
+	const int offset = std::min((int)scaled, (int)bins.size() - 1);
+	const float up = std::min(scaled - offset, OneMinusEpsilon);
+
+	const Bin& bin = bins[offset];
+	if (up < bin.q) {
+		if (pmf)
+			*pmf = bin.p;
+		if (uRemapped)
+			*uRemapped = std::min(up / bin.q, OneMinusEpsilon);
+		return offset;
+	}
+
+	const int alias = bin.alias;
+	if (pmf)
+		*pmf = bins[alias].p;
+	if (uRemapped)
+		*uRemapped = std::min((up - bin.q) / (1 - bin.q), OneMinusEpsilon);
+	return alias;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef APOLLO_CORE_SAMPLING_H
+#define APOLLO_CORE_SAMPLING_H
+
+#include "apollo.h"
+#include "point2.h"
+#include "vector3.h"
+#include "rng.h"
+
+namespace apollo {
+
+// Map a uniform sample from [0, 1)^2 to the unit disk, preserving relative areas (Shirley-Chiu mapping)
+inline Point2f ConcentricSampleDisk(const Point2f& u) {
+	// Map uniform sample to [-1, 1]^2
+	float x = 2.0f * u.x - 1.0f;
+	float y = 2.0f * u.y - 1.0f;
+	if (x == 0.0f && y == 0.0f)
+		return Point2f(0.0f, 0.0f);
+
+	// Squish the square to the disk
+	float r, theta;
+	if (std::abs(x) > std::abs(y)) {
+		r = x;
+		theta = (PI / 4) * (y / x);
+	} else {
+		r = y;
+		theta = (PI / 2) - (PI / 4) * (x / y);
+	}
+
+	return Point2f(r * std::cos(theta), r * std::sin(theta));
+}
+
+// Cosine-weighted direction on the hemisphere around +z
+inline Vector3f CosineSampleHemisphere(const Point2f& u) {
+	Point2f d = ConcentricSampleDisk(u);
+	float z = std::sqrt(std::max(0.0f, 1.0f - d.x * d.x - d.y * d.y));
+	return Vector3f(d.x, d.y, z);
+}
+
+// Probability density of a cosine-weighted direction
+inline float CosineHemispherePdf(float cosTheta) {
+	return cosTheta * InvPI;
+}
+
+// Uniformly distributed barycentrics (b0, b1) of a point on a triangle
+inline Point2f UniformSampleTriangle(const Point2f& u) {
+	float su0 = std::sqrt(u.x);
+	return Point2f(1 - su0, u.y * su0);
+}
+
+// Multiple importance sampling weight of a sample taken with density fPdf, when another strategy could have produced it
+// with density gPdf (power heuristic with beta = 2)
+inline float PowerHeuristic(float fPdf, float gPdf) {
+	const float f = fPdf * fPdf, g = gPdf * gPdf;
+	return f + g > 0.0f ? f / (f + g) : 0.0f;
+}
+
+// Piecewise-constant distribution over [0, 1) with n equally sized segments, sampled by inverting its CDF
+class Distribution1D {
+	public:
+		// Distribution proportional to the n non-negative values of f; uniform if they are all zero
+		Distribution1D(const float* f, int n);
+
+		// Number of segments
+		int Count() const { return (int)func.size(); }
+
+		// Sample a point in [0, 1); returns its density and optionally the index of its segment
+		float SampleContinuous(float u, float* pdf, int* offset = nullptr) const;
+
+		// Function values, CDF at the n + 1 segment boundaries and the integral of the function
+		std::vector<float> func, cdf;
+		float funcInt;
+};
+
+// Piecewise-constant distribution over [0, 1)^2, sampled as a marginal distribution over the rows followed by the
+// conditional distribution within the chosen row
+class Distribution2D {
+	public:
+		// Distribution proportional to func, given as nv rows of nu non-negative values; the rows are built in parallel
+		Distribution2D(const float* func, int nu, int nv);
+
+		// Sample a point in [0, 1)^2 and return its density
+		Point2f SampleContinuous(const Point2f& u, float* pdf) const;
+
+		// Density of sampling a point
+		float Pdf(const Point2f& p) const;
+
+	private:
+		std::vector<std::unique_ptr<Distribution1D>> pConditionalV;
+		std::unique_ptr<Distribution1D> pMarginal;
+};
+
+// Discrete distribution sampled in constant time with Walker's alias method (Vose's construction)
+// Every bin holds the probability q of keeping its own index and the index it otherwise aliases to, so a sample costs
+// one bin lookup and one comparison however many entries there are
+class AliasTable {
+	public:
+		AliasTable() = default;
+
+		// Table for probabilities proportional to the weights, which must be non-negative; all-zero weights are sampled uniformly
+		explicit AliasTable(const std::vector<float>& weights);
+
+		// Index sampled from u in [0, 1); optionally returns its probability and u remapped to [0, 1) for reuse
+		// The table must not be empty
+		int Sample(float u, float* pmf = nullptr, float* uRemapped = nullptr) const;
+
+		// Probability of sampling an index
+		float PMF(int index) const { return bins[index].p; }
+
+		size_t size() const { return bins.size(); }
+
+	private:
+		struct Bin {
+			// Probability of keeping the bin's own index, probability of the index, and the index taken otherwise
+			float q, p;
+			int alias;
+		};
+		std::vector<Bin> bins;
+};
+
+}
+
+#endif
@@ -0,0 +1,31 @@
+#include "scene.h"
+
+namespace apollo {
+
+Scene::Scene(const std::vector<std::shared_ptr<Primitive>>& primitives, const std::vector<std::shared_ptr<Light>>& lights,
+	LightSampling lightSampling, const std::shared_ptr<EnvironmentLight>& environmentLight)
+	: lights(lights), environmentLight(environmentLight), aggregate(std::make_shared<BVHAccel>(primitives)), lightSampler(CreateLightSampler(lightSampling, lights)) {
+	worldBound = aggregate->WorldBound();
+}
+
+// Bounding box of the whole scene in world space
+const Bounds3f& Scene::WorldBound() const {
+	return worldBound;
+}
+
+// Find the closest intersection between the ray and the scene
+bool Scene::Intersect(const Ray& ray, SurfaceInteraction* surf) const {
+	return aggregate->Intersect(ray, surf);
+}
+
+// Check if the ray hits anything (used for shadow rays)
+bool Scene::IntersectP(const Ray& ray) const {
+	return aggregate->IntersectP(ray);
+}
+
+// Find the closest intersection of every ray in a coherent packet
+void Scene::IntersectPacket(const RayPacket& packet, SurfaceInteraction* surfs, bool* hits) const {
+	aggregate->IntersectPacket(packet, surfs, hits);
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef APOLLO_CORE_SCENE_H
+#define APOLLO_CORE_SCENE_H
+
+#include "apollo.h"
+#include "bounds3.h"
+#include "ray.h"
+#include "interaction.h"
+#include "primitive.h"
+#include "light.h"
+#include "bvh.h"
+#include "lightsampler.h"
+#include "environment.h"
+
+namespace apollo {
+
+// Scene stores all primitives (behind an acceleration structure) and lights
+// Unless every light is sampled at every shading point, the scene also builds the light sampler integrators choose lights with
+// An optional environment light surrounds the scene; it is sampled at every shading point in addition to the chosen lights
+class Scene {
+	public:
+		Scene(const std::vector<std::shared_ptr<Primitive>>& primitives, const std::vector<std::shared_ptr<Light>>& lights,
+		      LightSampling lightSampling = LightSampling::All, const std::shared_ptr<EnvironmentLight>& environmentLight = nullptr);
+
+		// Bounding box of the whole scene in world space
+		const Bounds3f& WorldBound() const;
+
+		// Find the closest intersection between the ray and the scene
+		bool Intersect(const Ray& ray, SurfaceInteraction* surf) const;
+
+		// Check if the ray hits anything (used for shadow rays)
+		bool IntersectP(const Ray& ray) const;
+
+		// Find the closest intersection of every ray in a coherent packet
+		void IntersectPacket(const RayPacket& packet, SurfaceInteraction* surfs, bool* hits) const;
+
+		// Sampler choosing one light per shading point (nullptr if every light is to be sampled)
+		const LightSampler* GetLightSampler() const { return lightSampler.get(); }
+
+	public:
+		std::vector<std::shared_ptr<Light>> lights;
+		// Light seen by rays that leave the scene (nullptr for a black background)
+		std::shared_ptr<EnvironmentLight> environmentLight;
+	private:
+		std::shared_ptr<BVHAccel> aggregate;
+		std::unique_ptr<LightSampler> lightSampler;
+		Bounds3f worldBound;
+};
+
+}
+
+#endif
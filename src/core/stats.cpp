@@ -0,0 +1,140 @@
+#include "stats.h"
+#include "stringprint.h"
+#include <mutex>
+
+namespace apollo {
+
+// Display and JSON names of the counters and phases
+static const char* CounterNames[] = {
+	"Camera rays", "Camera ray hits",
+	"Indirect rays", "Indirect ray hits",
+	"Shadow rays", "Shadow rays occluded",
+	"BVH nodes visited",
+	"Triangle tests", "Triangle hits",
+	"Sphere tests", "Sphere hits",
+	"Texture tile lookups", "Texture tile misses"
+};
+
+static const char* CounterKeys[] = {
+	"camera_rays", "camera_ray_hits",
+	"indirect_rays", "indirect_ray_hits",
+	"shadow_rays", "shadow_rays_occluded",
+	"bvh_nodes_visited",
+	"triangle_tests", "triangle_hits",
+	"sphere_tests", "sphere_hits",
+	"texture_tile_lookups", "texture_tile_misses"
+};
+
+static const char* PhaseNames[] = { "load", "build", "render", "write" };
+
+static_assert(sizeof(CounterNames) / sizeof(CounterNames[0]) == (int)StatCounter::Count, "Missing counter name");
+static_assert(sizeof(CounterKeys) / sizeof(CounterKeys[0]) == (int)StatCounter::Count, "Missing counter key");
+static_assert(sizeof(PhaseNames) / sizeof(PhaseNames[0]) == (int)StatPhase::Count, "Missing phase name");
+
+#ifdef APOLLO_STATS
+
+static std::mutex statsMutex;
+static ThreadStats totalStats;
+
+// Add the statistics of the calling thread to the global totals and reset them
+void MergeThreadStats() {
+	std::lock_guard<std::mutex> lock(statsMutex);
+	for (int i = 0; i < (int)StatCounter::Count; i++)
+		totalStats.counters[i] += threadStats.counters[i];
+	for (int i = 0; i < (int)StatPhase::Count; i++)
+		totalStats.phaseNanoseconds[i] += threadStats.phaseNanoseconds[i];
+	threadStats = ThreadStats();
+}
+
+// Merged statistics of all threads, including the calling one
+static ThreadStats GatherStats() {
+	MergeThreadStats();
+	std::lock_guard<std::mutex> lock(statsMutex);
+	return totalStats;
+}
+
+// Ratio of two counters in percent
+static double Percent(uint64_t part, uint64_t total) {
+	return total ? 100.0 * part / total : 0.0;
+}
+
+// Print a summary of all statistics gathered so far
+void ReportStats(std::ostream& out) {
+	ThreadStats stats = GatherStats();
+	auto counter = [&](StatCounter c) { return stats.counters[(int)c]; };
+
+	out << "Statistics\n";
+
+	// Counters, with the hit rate of every test/hit pair
+	const StatCounter pairs[][2] = {
+		{ StatCounter::CameraRays, StatCounter::CameraRayHits },
+		{ StatCounter::IndirectRays, StatCounter::IndirectRayHits },
+		{ StatCounter::ShadowRays, StatCounter::ShadowRaysOccluded },
+		{ StatCounter::TriangleTests, StatCounter::TriangleHits },
+		{ StatCounter::SphereTests, StatCounter::SphereHits },
+		{ StatCounter::TextureTileLookups, StatCounter::TextureTileMisses }
+	};
+	for (const auto& pair : pairs) {
+		out << StringPrintf("    %-24s %16llu\n", CounterNames[(int)pair[0]], (unsigned long long)counter(pair[0]));
+		out << StringPrintf("    %-24s %16llu (%.2f", CounterNames[(int)pair[1]], (unsigned long long)counter(pair[1]),
+			Percent(counter(pair[1]), counter(pair[0]))) << "%)\n";
+	}
+
+	uint64_t rays = counter(StatCounter::CameraRays) + counter(StatCounter::IndirectRays) + counter(StatCounter::ShadowRays);
+	uint64_t nodes = counter(StatCounter::BVHNodesVisited);
+	out << StringPrintf("    %-24s %16llu (%.2f per ray)\n", CounterNames[(int)StatCounter::BVHNodesVisited], (unsigned long long)nodes,
+		rays ? (double)nodes / rays : 0.0);
+
+	// Phase timings
+	for (int i = 0; i < (int)StatPhase::Count; i++)
+		out << StringPrintf("    %-24s %16.3f s\n", (std::string("Time: ") + PhaseNames[i]).c_str(), stats.phaseNanoseconds[i] * 1e-9);
+}
+
+// Write all statistics gathered so far as JSON
+bool WriteStatsJSON(const std::string& filename) {
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	ThreadStats stats = GatherStats();
+	out << "{\n  \"counters\": {\n";
+	for (int i = 0; i < (int)StatCounter::Count; i++)
+		out << StringPrintf("    \"%s\": %llu%s\n", CounterKeys[i], (unsigned long long)stats.counters[i],
+			i + 1 < (int)StatCounter::Count ? "," : "");
+	out << "  },\n  \"phase_seconds\": {\n";
+	for (int i = 0; i < (int)StatPhase::Count; i++)
+		out << StringPrintf("    \"%s\": %.9g%s\n", PhaseNames[i], stats.phaseNanoseconds[i] * 1e-9,
+			i + 1 < (int)StatPhase::Count ? "," : "");
+	out << "  }\n}\n";
+
+	return (bool)out;
+}
+
+// Reset all statistics
+void ClearStats() {
+	std::lock_guard<std::mutex> lock(statsMutex);
+	totalStats = ThreadStats();
+	threadStats = ThreadStats();
+}
+
+#else
+
+// Print a summary of all statistics gathered so far
+void ReportStats(std::ostream& out) {
+	out << "Statistics are disabled (configure with -DAPOLLO_ENABLE_STATS=ON)\n";
+}
+
+// Write all statistics gathered so far as JSON
+bool WriteStatsJSON(const std::string&) {
+	std::cerr << "Statistics are disabled (configure with -DAPOLLO_ENABLE_STATS=ON)" << std::endl;
+	return false;
+}
+
+// Reset all statistics
+void ClearStats() {}
+
+#endif
+
+}
@@ -0,0 +1,90 @@
+#ifndef APOLLO_CORE_STATS_H
+#define APOLLO_CORE_STATS_H
+
+#include "apollo.h"
+#include <cstdint>
+#include <chrono>
+
+namespace apollo {
+
+// Render statistics
+// =================
+// Statistics are collected only when APOLLO_STATS is defined (configure with -DAPOLLO_ENABLE_STATS=ON);
+// otherwise all STAT_* macros expand to nothing. Every thread counts into its own storage,
+// which is merged into the global totals when a worker finishes and before reporting
+
+// Event counters
+enum class StatCounter {
+	CameraRays, CameraRayHits,
+	IndirectRays, IndirectRayHits,
+	ShadowRays, ShadowRaysOccluded,
+	BVHNodesVisited,
+	TriangleTests, TriangleHits,
+	SphereTests, SphereHits,
+	TextureTileLookups, TextureTileMisses,
+	Count
+};
+
+// Timed phases of a render
+enum class StatPhase {
+	Load, Build, Render, Write,
+	Count
+};
+
+// Per-thread statistics storage
+struct ThreadStats {
+	uint64_t counters[(int)StatCounter::Count];
+	uint64_t phaseNanoseconds[(int)StatPhase::Count];
+};
+
+// Print a summary of all statistics gathered so far
+void ReportStats(std::ostream& out);
+
+// Write all statistics gathered so far as JSON
+bool WriteStatsJSON(const std::string& filename);
+
+// Reset all statistics
+void ClearStats();
+
+#ifdef APOLLO_STATS
+
+// Statistics of the calling thread (zero initialized, so access needs no guard)
+inline thread_local ThreadStats threadStats;
+
+// Add the statistics of the calling thread to the global totals and reset them
+void MergeThreadStats();
+
+// Measure the time spent in a phase until the end of the enclosing scope
+class StatPhaseTimer {
+	public:
+		StatPhaseTimer(StatPhase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+		~StatPhaseTimer() {
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			threadStats.phaseNanoseconds[(int)phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		}
+
+	private:
+		const StatPhase phase;
+		const std::chrono::steady_clock::time_point start;
+};
+
+#define STAT_CONCAT_INNER(a, b) a##b
+#define STAT_CONCAT(a, b) STAT_CONCAT_INNER(a, b)
+
+#define STAT_INC(counter) (++apollo::threadStats.counters[(int)apollo::StatCounter::counter])
+#define STAT_ADD(counter, n) (apollo::threadStats.counters[(int)apollo::StatCounter::counter] += (n))
+#define STAT_PHASE(phase) apollo::StatPhaseTimer STAT_CONCAT(statPhaseTimer, __LINE__)(apollo::StatPhase::phase)
+
+#else
+
+inline void MergeThreadStats() {}
+
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_PHASE(phase) ((void)0)
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include "tonemap.h"
+#include "parallel.h"
+#include "trace.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace apollo {
+
+// Number of floats converted per chunk; chunks are the unit of work split between threads
+static const size_t ChunkSize = 16384;
+
+// Encoded values are looked up with this many entries over [0, 1]
+static const int EncodeTableSize = 4096;
+
+// Table mapping a quantized linear value in [0, 1] to its encoded 8-bit value
+struct EncodeTable {
+	uint8_t values[EncodeTableSize];
+};
+
+// sRGB transfer function
+static float EncodeSRGB(float x) {
+	return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+}
+
+static void BuildEncodeTable(ToneEncoding encoding, float gamma, EncodeTable* table) {
+	for (int i = 0; i < EncodeTableSize; i++) {
+		float x = (float)i / (EncodeTableSize - 1);
+		float y = encoding == ToneEncoding::SRGB ? EncodeSRGB(x) : std::pow(x, 1.0f / gamma);
+		table->values[i] = (uint8_t)(Clamp(y, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+// The sRGB table never changes, so it is built once
+static const EncodeTable& SRGBTable() {
+	static const EncodeTable table = [] {
+		EncodeTable t;
+		BuildEncodeTable(ToneEncoding::SRGB, 1.0f, &t);
+		return t;
+	}();
+	return table;
+}
+
+// Kernels on a single chunk
+// =========================
+
+static void ExposeAndClampChunk(const float* in, size_t n, float exposure, float* out) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(exposure), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= n; i += 4) {
+		// max returns its second operand when the first one is NaN
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+		_mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(x, zero), one));
+	}
+#endif
+	for (; i < n; i++) {
+		float x = in[i] * exposure;
+		out[i] = x > 0.0f ? std::min(x, 1.0f) : 0.0f;
+	}
+}
+
+static void QuantizeLinearChunk(const float* in, size_t n, uint8_t* out) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+	for (; i + 16 <= n; i += 16) {
+		// Truncate to 32-bit integers and narrow them with saturating packs
+		__m128i a = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half));
+		__m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), half));
+		__m128i c = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 8), scale), half));
+		__m128i d = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 12), scale), half));
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), bytes);
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = (uint8_t)(in[i] * 255.0f + 0.5f);
+}
+
+static void QuantizeTableChunk(const float* in, size_t n, const EncodeTable& table, uint8_t* out) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(EncodeTableSize - 1), half = _mm_set1_ps(0.5f);
+	alignas(16) int32_t index[4];
+	for (; i + 4 <= n; i += 4) {
+		__m128i k = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half));
+		_mm_store_si128(reinterpret_cast<__m128i*>(index), k);
+		out[i] = table.values[index[0]];
+		out[i + 1] = table.values[index[1]];
+		out[i + 2] = table.values[index[2]];
+		out[i + 3] = table.values[index[3]];
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = table.values[(int)(in[i] * (EncodeTableSize - 1) + 0.5f)];
+}
+
+static void EncodeAndQuantizeChunk(const float* in, size_t n, ToneEncoding encoding, const EncodeTable* table, uint8_t* out) {
+	if (encoding == ToneEncoding::Linear)
+		QuantizeLinearChunk(in, n, out);
+	else
+		QuantizeTableChunk(in, n, *table, out);
+}
+
+// Run func(begin, end) over [0, n) in chunks, on all threads when there is more than one chunk
+static void ForEachChunk(size_t n, const std::function<void(size_t, size_t)>& func) {
+	const int64_t nChunks = (int64_t)((n + ChunkSize - 1) / ChunkSize);
+	if (nChunks <= 1) {
+		func(0, n);
+		return;
+	}
+	ParallelFor([&](int64_t chunk) {
+		size_t begin = (size_t)chunk * ChunkSize;
+		func(begin, std::min(begin + ChunkSize, n));
+	}, nChunks);
+}
+
+// Whole-Image Tone Mapping
+// ========================
+
+// Convert the whole film to 8-bit RGB; every chunk is exposed into a small buffer that stays in cache and encoded from there
+void ToneMap(const Film& film, const ToneMapSettings& settings, uint8_t* out) {
+	TRACE_SCOPE("Tone map", "write");
+	const float* in = reinterpret_cast<const float*>(film.GetPixels());
+	const size_t n = 3 * (size_t)film.resolution.x * film.resolution.y;
+
+	EncodeTable gammaTable;
+	const EncodeTable* table = &SRGBTable();
+	if (settings.encoding == ToneEncoding::Gamma) {
+		BuildEncodeTable(settings.encoding, settings.gamma, &gammaTable);
+		table = &gammaTable;
+	}
+
+	ForEachChunk(n, [&](size_t begin, size_t end) {
+		// Every thread reuses its own buffer for all the chunks it converts
+		thread_local std::vector<float> buffer(ChunkSize);
+		ExposeAndClampChunk(in + begin, end - begin, settings.exposure, buffer.data());
+		EncodeAndQuantizeChunk(buffer.data(), end - begin, settings.encoding, table, out + begin);
+	});
+}
+
+}
@@ -0,0 +1,28 @@
+#ifndef APOLLO_CORE_TONEMAP_H
+#define APOLLO_CORE_TONEMAP_H
+
+#include "apollo.h"
+#include "film.h"
+
+namespace apollo {
+
+// Transfer function applied when converting linear radiance to display values
+enum class ToneEncoding { Linear, SRGB, Gamma };
+
+// Settings of the film to 8-bit conversion
+struct ToneMapSettings {
+	// Scale applied to the radiance before clamping
+	float exposure = 1.0f;
+	ToneEncoding encoding = ToneEncoding::Linear;
+	// Exponent of ToneEncoding::Gamma (values are raised to 1 / gamma)
+	float gamma = 2.2f;
+};
+
+// Convert the whole film to 8-bit RGB (3 bytes per pixel, row by row) in a single fused pass
+// Radiance is scaled by the exposure and clamped to [0, 1] (NaNs become 0), then encoded and quantized to 8 bits;
+// sRGB and gamma go through a lookup table. The pass is vectorized with SSE and split across threads for large images
+void ToneMap(const Film& film, const ToneMapSettings& settings, uint8_t* out);
+
+}
+
+#endif
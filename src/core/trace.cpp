@@ -0,0 +1,143 @@
+#include "trace.h"
+#include "parallel.h"
+#include "stringprint.h"
+#include <chrono>
+#include <mutex>
+
+namespace apollo {
+
+#ifdef APOLLO_TRACE
+
+// Number of events every thread keeps before overwriting its oldest ones
+static constexpr size_t TraceBufferSize = 1 << 16;
+
+struct TraceEvent {
+	const char* name;
+	const char* category;
+	uint64_t start, end;
+	int thread;
+};
+
+// Fixed size ring buffer of the events of one thread
+struct TraceBuffer {
+	TraceBuffer() : events(TraceBufferSize), next(0), count(0), dropped(0) {}
+
+	std::vector<TraceEvent> events;
+	size_t next, count;
+	// Events overwritten because the buffer was full
+	uint64_t dropped;
+};
+
+// Allocated on the first event of a thread
+static thread_local TraceBuffer* threadTraceBuffer = nullptr;
+
+static std::mutex traceMutex;
+static std::vector<TraceEvent> traceEvents;
+static uint64_t droppedTraceEvents = 0;
+static std::string traceFilename;
+static const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+// Microseconds since the start of tracing
+uint64_t TraceTimestamp() {
+	auto elapsed = std::chrono::steady_clock::now() - traceEpoch;
+	return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+// Record a completed event into the ring buffer of the calling thread
+void RecordTraceEvent(const char* name, const char* category, uint64_t start, uint64_t end) {
+	if (!threadTraceBuffer)
+		threadTraceBuffer = new TraceBuffer();
+
+	TraceBuffer& buffer = *threadTraceBuffer;
+	if (buffer.count == TraceBufferSize)
+		buffer.dropped++;
+	buffer.events[buffer.next] = { name, category, start, end, ThreadIndex };
+	buffer.next = (buffer.next + 1) % TraceBufferSize;
+	buffer.count = std::min(buffer.count + 1, TraceBufferSize);
+}
+
+// Hand the events of the calling thread over to the global event list
+void FlushThreadTrace() {
+	if (!threadTraceBuffer)
+		return;
+
+	TraceBuffer& buffer = *threadTraceBuffer;
+	size_t first = (buffer.next + TraceBufferSize - buffer.count) % TraceBufferSize;
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+		for (size_t i = 0; i < buffer.count; i++)
+			traceEvents.push_back(buffer.events[(first + i) % TraceBufferSize]);
+		droppedTraceEvents += buffer.dropped;
+	}
+
+	delete threadTraceBuffer;
+	threadTraceBuffer = nullptr;
+}
+
+// Write the trace file registered by EnableTracing
+static void WriteTraceAtExit() {
+	WriteChromeTrace(traceFilename);
+}
+
+// Start recording trace events; they are written to the given file at program exit
+void EnableTracing(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(traceMutex);
+	if (traceFilename.empty())
+		std::atexit(WriteTraceAtExit);
+	traceFilename = filename;
+	tracingEnabled = true;
+}
+
+// Write all trace events recorded so far in Chrome trace JSON format
+bool WriteChromeTrace(const std::string& filename) {
+	FlushThreadTrace();
+
+	std::ofstream out(filename);
+	if (!out) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(traceMutex);
+
+	// Name the thread lanes after the render threads
+	int maxThread = 0;
+	for (const TraceEvent& e : traceEvents)
+		maxThread = std::max(maxThread, e.thread);
+
+	std::vector<std::string> entries;
+	for (int t = 0; t <= maxThread; t++)
+		entries.push_back(StringPrintf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+			t, t == 0 ? "Main" : "Worker", t));
+
+	for (const TraceEvent& e : traceEvents)
+		entries.push_back(StringPrintf("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%d}",
+			e.name, e.category, (unsigned long long)e.start, (unsigned long long)(e.end - e.start), e.thread));
+
+	out << "{\"traceEvents\":[\n";
+	for (size_t i = 0; i < entries.size(); i++)
+		out << entries[i] << (i + 1 < entries.size() ? ",\n" : "\n");
+	// The oldest events of overflowing threads are missing, so the timeline is incomplete
+	if (droppedTraceEvents > 0)
+		std::cerr << "Trace is incomplete: " << droppedTraceEvents << " events were dropped by full per-thread buffers" << std::endl;
+	out << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << droppedTraceEvents << "}}\n";
+
+	return (bool)out;
+}
+
+#else
+
+// Start recording trace events; they are written to the given file at program exit
+void EnableTracing(const std::string&) {
+	std::cerr << "Tracing is disabled (configure with -DAPOLLO_ENABLE_TRACE=ON)" << std::endl;
+}
+
+// Write all trace events recorded so far in Chrome trace JSON format
+bool WriteChromeTrace(const std::string&) {
+	std::cerr << "Tracing is disabled (configure with -DAPOLLO_ENABLE_TRACE=ON)" << std::endl;
+	return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,69 @@
+#ifndef APOLLO_CORE_TRACE_H
+#define APOLLO_CORE_TRACE_H
+
+#include "apollo.h"
+#include <cstdint>
+#include <atomic>
+
+namespace apollo {
+
+// Timeline tracing
+// ================
+// Trace events are compiled in only when APOLLO_TRACE is defined (configure with -DAPOLLO_ENABLE_TRACE=ON)
+// and recorded once tracing is enabled at runtime. Every thread records into its own ring buffer,
+// which is handed over to the global event list when a worker finishes. Events overwritten in a full
+// buffer are counted and reported when the trace is written. The result is written in Chrome trace
+// format, viewable in chrome://tracing or ui.perfetto.dev
+
+// Start recording trace events; they are written to the given file at program exit
+void EnableTracing(const std::string& filename);
+
+// Write all trace events recorded so far in Chrome trace JSON format
+bool WriteChromeTrace(const std::string& filename);
+
+#ifdef APOLLO_TRACE
+
+// Set once tracing has been enabled
+inline std::atomic<bool> tracingEnabled{false};
+
+// Microseconds since the start of tracing
+uint64_t TraceTimestamp();
+
+// Record a completed event into the ring buffer of the calling thread
+void RecordTraceEvent(const char* name, const char* category, uint64_t start, uint64_t end);
+
+// Hand the events of the calling thread over to the global event list
+void FlushThreadTrace();
+
+// Record the enclosing scope as a trace event; name and category must be string literals
+class TraceScope {
+	public:
+		TraceScope(const char* name, const char* category) : name(name), category(category),
+			start(tracingEnabled.load(std::memory_order_relaxed) ? TraceTimestamp() : 0) {}
+		~TraceScope() {
+			if (tracingEnabled.load(std::memory_order_relaxed))
+				RecordTraceEvent(name, category, start, TraceTimestamp());
+		}
+
+	private:
+		const char* const name;
+		const char* const category;
+		const uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_SCOPE(name, category) apollo::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, category)
+
+#else
+
+inline void FlushThreadTrace() {}
+
+#define TRACE_SCOPE(name, category) ((void)0)
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "apollo.h"
+#include "transformcache.h"
+#include <cstring>
+
+namespace apollo {
+
+TransformCache transformCache;
+
+TransformCache::TransformCache() : hashTable(512, nullptr) {}
+
+// Get the shared copy of t (adding it if it is not cached yet)
+const Transform* TransformCache::Lookup(const Transform& t) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t mask = hashTable.size() - 1;
+	size_t slot = Hash(t) & mask;
+	while (hashTable[slot]) {
+		if (*hashTable[slot] == t)
+			return hashTable[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	// Keep the load factor under one half
+	transforms.push_back(t);
+	const Transform* cached = &transforms.back();
+	if (2 * transforms.size() > hashTable.size()) {
+		Grow();
+		mask = hashTable.size() - 1;
+		slot = Hash(t) & mask;
+		while (hashTable[slot])
+			slot = (slot + 1) & mask;
+	}
+	hashTable[slot] = cached;
+
+	return cached;
+}
+
+// Get the shared copies of t and its inverse
+void TransformCache::Lookup(const Transform& t, const Transform** tCached, const Transform** tCachedInv) {
+	if (tCached)
+		*tCached = Lookup(t);
+	if (tCachedInv)
+		*tCachedInv = Lookup(t.Inverse());
+}
+
+// Number of distinct transforms stored
+size_t TransformCache::Size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return transforms.size();
+}
+
+// Release all transforms; previously returned pointers become invalid
+void TransformCache::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	transforms.clear();
+	hashTable.assign(512, nullptr);
+}
+
+// Hash the matrix contents of a transform (FNV-1a over the raw bytes)
+uint64_t TransformCache::Hash(const Transform& t) {
+	// Adding zero maps -0 to +0 so that equal matrices hash equally
+	const Matrix m = t.GetMatrix();
+	float values[16];
+	for (int i = 0; i < 16; i++)
+		values[i] = m.m[i] + 0.0f;
+
+	unsigned char bytes[sizeof(values)];
+	std::memcpy(bytes, values, sizeof(values));
+
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof(bytes); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Double the table size and reinsert all entries
+void TransformCache::Grow() {
+	std::vector<const Transform*> newTable(2 * hashTable.size(), nullptr);
+	size_t mask = newTable.size() - 1;
+
+	for (const Transform* t : hashTable) {
+		if (!t)
+			continue;
+		size_t slot = Hash(*t) & mask;
+		while (newTable[slot])
+			slot = (slot + 1) & mask;
+		newTable[slot] = t;
+	}
+
+	hashTable.swap(newTable);
+}
+
+}
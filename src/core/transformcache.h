@@ -0,0 +1,48 @@
+#ifndef APOLLO_CORE_TRANSFORM_CACHE_H
+#define APOLLO_CORE_TRANSFORM_CACHE_H
+
+#include "apollo.h"
+#include "transform.h"
+#include <deque>
+#include <mutex>
+
+namespace apollo {
+
+// Interns transforms so that shapes and lights sharing the same matrix point
+// to a single copy. Returned pointers stay valid until Clear() is called.
+class TransformCache {
+	public:
+		TransformCache();
+
+		// Get the shared copy of t (adding it if it is not cached yet)
+		const Transform* Lookup(const Transform& t);
+
+		// Get the shared copies of t and its inverse
+		void Lookup(const Transform& t, const Transform** tCached, const Transform** tCachedInv);
+
+		// Number of distinct transforms stored
+		size_t Size() const;
+
+		// Release all transforms; previously returned pointers become invalid
+		void Clear();
+
+	private:
+		// Hash the matrix contents of a transform
+		static uint64_t Hash(const Transform& t);
+
+		// Double the table size and reinsert all entries
+		void Grow();
+
+		// Deque keeps elements in place as it grows, so pointers stay stable
+		std::deque<Transform> transforms;
+		// Open addressing table (linear probing) of pointers into transforms
+		std::vector<const Transform*> hashTable;
+		mutable std::mutex mutex;
+};
+
+// Cache used while building the scene
+extern TransformCache transformCache;
+
+}
+
+#endif
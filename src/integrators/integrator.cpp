@@ -0,0 +1,326 @@
+#include "integrator.h"
+#include "parallel.h"
+#include "sampling.h"
+#include "stats.h"
+#include "trace.h"
+#include "spectrum.h"
+#include "bsdf.h"
+
+namespace apollo {
+
+// Shading routines shared between integrators
+// ===========================================
+
+// Compute the radiance a point light reflects from a diffuse surface point, ignoring visibility
+bool SampleLightContribution(const Light& light, const Interaction& it, const Normal3f& n, RGB* L, Ray* shadowRay) {
+	float weight;
+	if (!SampleLightWeight(light, it, n, &weight, shadowRay))
+		return false;
+	*L = light.color * weight;
+	return true;
+}
+
+// Factor the emission of a point light is scaled by when reflected from a diffuse surface point
+bool SampleLightWeight(const Light& light, const Interaction& it, const Normal3f& n, float* weight, Ray* shadowRay) {
+	Point3f pLight = (*light.lightToWorld)(Point3f(0.0f));
+	Vector3f wi = pLight - it.p();
+	float dist2 = wi.LengthSquared();
+	float dist = std::sqrt(dist2);
+	wi /= dist;
+
+	float cosTheta = Dot(wi, n);
+	if (cosTheta <= 0.0f)
+		return false;
+
+	*weight = light.intensity * DiffuseAlbedo * InvPI * cosTheta / dist2;
+	*shadowRay = it.SpawnRayTo(pLight);
+	return true;
+}
+
+// Compute the radiance the environment light reflects from a diffuse surface point along a sampled direction
+bool SampleEnvironmentContribution(const EnvironmentLight& light, const Interaction& it, const Normal3f& n, const Point2f& u, bool mis,
+	RGB* L, Ray* shadowRay) {
+	Vector3f wi;
+	float lightPdf;
+	const RGB Le = light.Sample(u, &wi, &lightPdf);
+	const float cosTheta = Dot(wi, n);
+	if (lightPdf == 0.0f || cosTheta <= 0.0f)
+		return false;
+
+	const float weight = mis ? PowerHeuristic(lightPdf, CosineHemispherePdf(cosTheta)) : 1.0f;
+	*L = Le * (DiffuseAlbedo * InvPI * cosTheta * weight / lightPdf);
+	*shadowRay = it.SpawnRay(wi);
+	return true;
+}
+
+// Radiance of the environment light arriving along a ray that left the scene
+RGB EnvironmentEmission(const EnvironmentLight& light, const Ray& ray, float bsdfPdf) {
+	const RGB Le = light.Le(ray.d);
+	if (bsdfPdf == 0.0f)
+		return Le;
+	return Le * PowerHeuristic(bsdfPdf, light.Pdf(ray.d));
+}
+
+// Sample a cosine-weighted bounce direction around the surface normal
+Vector3f SampleDiffuseBounce(const Normal3f& n, const Point2f& u) {
+	Vector3f local = CosineSampleHemisphere(u);
+	Vector3f nz(n), nx, ny;
+	CoordinateSystem(nz, &nx, &ny);
+	return nx * local.x + ny * local.y + nz * local.z;
+}
+
+// Normalized surface normal flipped to the side the ray arrived from
+Normal3f ShadingNormal(const SurfaceInteraction& surf) {
+	Normal3f n = surf.n().Normalized();
+	if (Dot(n, surf.wo()) < 0.0f)
+		n *= -1;
+	return n;
+}
+
+// Camera sample jittered over the area of a pixel, with a random lens position and shutter time
+CameraSample SampleCamera(const Point2i& pixel, RNG& rng) {
+	CameraSample sample;
+	float jx = rng.UniformFloat() - 0.5f;
+	float jy = rng.UniformFloat() - 0.5f;
+	sample.pFilm = Point2f(pixel.x + jx, pixel.y + jy);
+	sample.pLens = Point2f(rng.UniformFloat(), rng.UniformFloat());
+	sample.time = rng.UniformFloat();
+	return sample;
+}
+
+// Depth-first path tracer
+// =======================
+
+PathIntegrator::PathIntegrator(const Camera& camera, Film& film, int samplesPerPixel, int maxDepth, int packetSize, bool spectral)
+	: camera(camera), film(film), samplesPerPixel(samplesPerPixel), maxDepth(maxDepth),
+	  packetSize(Clamp(packetSize, 1, 8)), spectral(spectral) {}
+
+// Render the scene into the film
+void PathIntegrator::Render(const Scene& scene) {
+	STAT_PHASE(Render);
+	TRACE_SCOPE("Render", "render");
+	const int tileSize = 16;
+	const Point2i res = film.resolution;
+	const Point2i nTiles((res.x + tileSize - 1) / tileSize, (res.y + tileSize - 1) / tileSize);
+
+	// Ray footprints shrink with the spacing of the pixel samples
+	const float differentialScale = 1 / std::sqrt((float)std::max(1, samplesPerPixel));
+
+	// Every render thread allocates its per-hit objects from its own arena, reset after every camera sample
+	// Tiles must not start a nested ParallelFor: its threads would reuse the thread indices and share arenas
+	std::unique_ptr<MemoryArena[]> arenas(new MemoryArena[NumSystemCores()]);
+
+	ParallelFor2D([&](Point2i tile) {
+		TRACE_SCOPE("Render tile", "render");
+		MemoryArena& arena = arenas[ThreadIndex];
+		int x0 = tile.x * tileSize, x1 = std::min(x0 + tileSize, res.x);
+		int y0 = tile.y * tileSize, y1 = std::min(y0 + tileSize, res.y);
+
+		if (packetSize > 1) {
+			for (int y = y0; y < y1; y += packetSize)
+				for (int x = x0; x < x1; x += packetSize)
+					RenderPacketBlock(scene, Point2i(x, y), Point2i(std::min(x + packetSize, x1), std::min(y + packetSize, y1)), arena);
+			return;
+		}
+
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				PixelCostScope costScope(film.HasCostAOV() ? &film.GetPixelCost(Point2i(x, y)) : nullptr);
+				RNG rng((uint64_t)y * res.x + x);
+				RGBA L;
+
+				// Jitter the samples over the pixel area
+				for (int s = 0; s < samplesPerPixel; s++) {
+					RayDifferential ray = camera.GenerateRayDifferential(SampleCamera(Point2i(x, y), rng));
+					ray.ScaleDifferentials(differentialScale);
+					SurfaceInteraction surf;
+					bool hit = scene.Intersect(ray, &surf);
+					L += SampleLi(ray, hit ? &surf : nullptr, scene, arena, rng);
+					arena.Reset();
+				}
+
+				film.GetPixel(Point2i(x, y)) = (L / (float)samplesPerPixel).ToRGB();
+			}
+		}
+	}, nTiles);
+}
+
+// Render the pixel block [pMin, pMax) one sample at a time, tracing the primary rays as a packet
+void PathIntegrator::RenderPacketBlock(const Scene& scene, const Point2i& pMin, const Point2i& pMax, MemoryArena& arena) {
+	const int width = film.resolution.x;
+	const int blockWidth = pMax.x - pMin.x;
+	const int nPixels = blockWidth * (pMax.y - pMin.y);
+	const float differentialScale = 1 / std::sqrt((float)std::max(1, samplesPerPixel));
+
+	// Every pixel keeps its own random stream, consumed in the same order as without packets
+	RNG rngs[MaxPacketSize];
+	RGBA L[MaxPacketSize];
+	for (int y = pMin.y, i = 0; y < pMax.y; y++)
+		for (int x = pMin.x; x < pMax.x; x++, i++)
+			rngs[i].SetSequence((uint64_t)y * width + x);
+
+	RayPacket packet;
+	CameraSample cameraSamples[MaxPacketSize];
+	SurfaceInteraction surfs[MaxPacketSize];
+	bool hits[MaxPacketSize];
+
+	// Packet traversal is shared by the block, so its cost is split evenly between the pixels
+	const bool recordCost = film.HasCostAOV();
+	PixelCost packetCost, pixelCosts[MaxPacketSize];
+
+	for (int s = 0; s < samplesPerPixel; s++) {
+		for (int i = 0; i < nPixels; i++)
+			cameraSamples[i] = SampleCamera(Point2i(pMin.x + i % blockWidth, pMin.y + i / blockWidth), rngs[i]);
+
+		{
+			PixelCostScope costScope(recordCost ? &packetCost : nullptr);
+			camera.GenerateRayPacket(pMin, pMax, cameraSamples, &packet);
+			scene.IntersectPacket(packet, surfs, hits);
+		}
+
+		// Continue every path on its own from the primary hit; the camera adds the differentials the packet rays lack
+		for (int i = 0; i < nPixels; i++) {
+			PixelCostScope costScope(recordCost ? &pixelCosts[i] : nullptr);
+			RayDifferential ray = camera.AddDifferentials(packet.rays[i], cameraSamples[i]);
+			ray.ScaleDifferentials(differentialScale);
+			L[i] += SampleLi(ray, hits[i] ? &surfs[i] : nullptr, scene, arena, rngs[i]);
+			arena.Reset();
+		}
+	}
+
+	for (int y = pMin.y, i = 0; y < pMax.y; y++) {
+		for (int x = pMin.x; x < pMax.x; x++, i++) {
+			film.GetPixel(Point2i(x, y)) = (L[i] / (float)samplesPerPixel).ToRGB();
+
+			if (recordCost) {
+				PixelCost& cost = film.GetPixelCost(Point2i(x, y));
+				cost += pixelCosts[i];
+				cost.traversalSteps += packetCost.traversalSteps / nPixels;
+				cost.primitiveTests += packetCost.primitiveTests / nPixels;
+				cost.nanoseconds += packetCost.nanoseconds / nPixels;
+			}
+		}
+	}
+}
+
+// Radiance arriving at the ray origin along the ray
+RGB PathIntegrator::Li(const RayDifferential& ray, const Scene& scene, MemoryArena& arena, RNG& rng) const {
+	SurfaceInteraction surf;
+	bool hit = scene.Intersect(ray, &surf);
+	return Li(ray, hit ? &surf : nullptr, scene, arena, rng);
+}
+
+// Radiance along a ray whose closest hit is already known (nullptr if the ray escaped)
+RGB PathIntegrator::Li(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, MemoryArena& arena, RNG& rng) const {
+	auto emission = [&](size_t i) { return scene.lights[i]->color; };
+	auto fromRGB = [](const RGB& rgb) { return rgb; };
+	return TracePath<RGB>(ray, firstHit, scene, emission, fromRGB, arena, rng);
+}
+
+// Spectral radiance at the sampled wavelengths along a ray whose closest hit is already known
+SampledSpectrum PathIntegrator::Li(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, const SampledWavelengths& lambda,
+	MemoryArena& arena, RNG& rng) const {
+	auto emission = [&](size_t i) { return scene.lights[i]->GetSpectrum().Sample(lambda); };
+	auto fromRGB = [&](const RGB& rgb) { return RGBUnboundedSpectrum(rgb).Sample(lambda); };
+	return TracePath<SampledSpectrum>(ray, firstHit, scene, emission, fromRGB, arena, rng);
+}
+
+// RGB radiance of one camera sample
+RGB PathIntegrator::SampleLi(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, MemoryArena& arena, RNG& rng) const {
+	if (!spectral)
+		return Li(ray, firstHit, scene, arena, rng);
+
+	SampledWavelengths lambda = SampledWavelengths::SampleUniform(rng.UniformFloat());
+	return SpectrumToRGB(Li(ray, firstHit, scene, lambda, arena, rng), lambda);
+}
+
+// Radiance along a path; the same loop serves RGB and spectral rendering
+template <typename Spectrum, typename Emission, typename FromRGB>
+Spectrum PathIntegrator::TracePath(const RayDifferential& cameraRay, const SurfaceInteraction* firstHit, const Scene& scene, const Emission& emission,
+	const FromRGB& fromRGB, MemoryArena& arena, RNG& rng) const {
+	Spectrum L(0.0f), beta(1.0f);
+	RayDifferential ray = cameraRay;
+	const EnvironmentLight* environmentLight = scene.environmentLight.get();
+	// Density the current ray direction was sampled with (0 for the camera ray)
+	float bsdfPdf = 0.0f;
+
+	for (int depth = 0; ; depth++) {
+		SurfaceInteraction surf;
+		if (depth == 0) {
+			STAT_INC(CameraRays);
+			if (!firstHit) {
+				if (environmentLight)
+					L += beta * fromRGB(EnvironmentEmission(*environmentLight, ray, bsdfPdf));
+				break;
+			}
+			STAT_INC(CameraRayHits);
+			surf = *firstHit;
+		} else {
+			STAT_INC(IndirectRays);
+			if (!scene.Intersect(ray, &surf)) {
+				if (environmentLight)
+					L += beta * fromRGB(EnvironmentEmission(*environmentLight, ray, bsdfPdf));
+				break;
+			}
+			STAT_INC(IndirectRayHits);
+		}
+
+		surf.ComputeScatteringFunctions(ray, arena, DiffuseAlbedo);
+		const BSDF& bsdf = *surf.bsdf;
+		const Normal3f& n = bsdf.ShadingNormal();
+
+		// Direct lighting from light i, divided by the probability of having chosen it
+		auto addDirectLighting = [&](size_t i, float pmf) {
+			float weight;
+			Ray shadowRay;
+			if (!SampleLightWeight(*scene.lights[i], surf, n, &weight, &shadowRay))
+				return;
+
+			STAT_INC(ShadowRays);
+			if (scene.IntersectP(shadowRay)) {
+				STAT_INC(ShadowRaysOccluded);
+				return;
+			}
+			L += beta * (emission(i) * (weight / pmf));
+		};
+
+		if (const LightSampler* lightSampler = scene.GetLightSampler()) {
+			// Add direct lighting from one light chosen by the light sampler
+			SampledLight sampled;
+			if (lightSampler->Sample(surf.p(), n, rng.UniformFloat(), &sampled))
+				addDirectLighting(sampled.index, sampled.p);
+		} else {
+			// Add direct lighting from every light
+			for (size_t i = 0; i < scene.lights.size(); i++)
+				addDirectLighting(i, 1.0f);
+		}
+
+		// Add direct lighting from the environment
+		if (environmentLight) {
+			RGB Le;
+			Ray shadowRay;
+			const Point2f u(rng.UniformFloat(), rng.UniformFloat());
+			if (SampleEnvironmentContribution(*environmentLight, surf, n, u, depth < maxDepth, &Le, &shadowRay)) {
+				STAT_INC(ShadowRays);
+				if (scene.IntersectP(shadowRay))
+					STAT_INC(ShadowRaysOccluded);
+				else
+					L += beta * fromRGB(Le);
+			}
+		}
+
+		if (depth == maxDepth)
+			break;
+
+		// Continue the path in a direction sampled from the BSDF
+		float weight;
+		Vector3f wi = bsdf.Sample(Point2f(rng.UniformFloat(), rng.UniformFloat()), &weight);
+		beta *= weight;
+		bsdfPdf = bsdf.Pdf(wi);
+		ray = surf.SpawnRay(wi);
+	}
+
+	return L;
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef APOLLO_INTEGRATORS_INTEGRATOR_H
+#define APOLLO_INTEGRATORS_INTEGRATOR_H
+
+#include "apollo.h"
+#include "scene.h"
+#include "camera.h"
+#include "film.h"
+#include "rng.h"
+#include "rgba.h"
+#include "sampledspectrum.h"
+#include "memory.h"
+
+namespace apollo {
+
+// Constant diffuse reflectance of all surfaces until materials are supported
+static constexpr float DiffuseAlbedo = 0.5f;
+
+// Base class of all rendering algorithms
+class Integrator {
+	public:
+		virtual ~Integrator() {}
+
+		// Render the scene into the film
+		virtual void Render(const Scene& scene) = 0;
+};
+
+// Shading routines shared between integrators
+// ===========================================
+
+// Compute the radiance a point light reflects from a diffuse surface point, ignoring visibility
+// Returns false if the light is behind the surface; otherwise fills in the shadow ray which must be unoccluded for L to count
+// n is the shading normal at the interaction point
+bool SampleLightContribution(const Light& light, const Interaction& it, const Normal3f& n, RGB* L, Ray* shadowRay);
+
+// Same as SampleLightContribution, but only returns the factor the light's emission is scaled by (L = light.color * weight)
+bool SampleLightWeight(const Light& light, const Interaction& it, const Normal3f& n, float* weight, Ray* shadowRay);
+
+// Compute the radiance the environment light reflects from a diffuse surface point along a direction sampled from the
+// light, ignoring visibility. With mis, the result is weighted against the chance of a cosine-weighted bounce finding
+// the same direction (only when the path continues; otherwise the light sample has to account for everything)
+// Returns false if the sampled direction is below the surface
+bool SampleEnvironmentContribution(const EnvironmentLight& light, const Interaction& it, const Normal3f& n, const Point2f& u, bool mis,
+	RGB* L, Ray* shadowRay);
+
+// Radiance of the environment light arriving along a ray that left the scene
+// bsdfPdf is the density the ray direction was sampled with by a bounce, weighted against light sampling; 0 for camera rays
+RGB EnvironmentEmission(const EnvironmentLight& light, const Ray& ray, float bsdfPdf);
+
+// Sample a cosine-weighted bounce direction around the surface normal
+Vector3f SampleDiffuseBounce(const Normal3f& n, const Point2f& u);
+
+// Normalized surface normal flipped to the side the ray arrived from
+Normal3f ShadingNormal(const SurfaceInteraction& surf);
+
+// Camera sample jittered over the area of a pixel, with a random lens position and shutter time
+CameraSample SampleCamera(const Point2i& pixel, RNG& rng);
+
+// Depth-first path tracer
+// Every camera sample is traced to completion before the next one starts; image tiles are rendered in parallel.
+// Primary rays of packetSize x packetSize pixel blocks are traced together as coherent packets (packetSize <= 1 disables packets)
+// In spectral mode every camera sample carries NSpectrumSamples hero-sampled wavelengths, converted to RGB when splatted to the film
+class PathIntegrator : public Integrator {
+	public:
+		PathIntegrator(const Camera& camera, Film& film, int samplesPerPixel, int maxDepth, int packetSize = 8, bool spectral = false);
+
+		// Render the scene into the film
+		void Render(const Scene& scene) override;
+
+		// Radiance arriving at the ray origin along the ray
+		// Per-hit shading objects are allocated in the arena, which the caller resets once the result is no longer needed
+		RGB Li(const RayDifferential& ray, const Scene& scene, MemoryArena& arena, RNG& rng) const;
+
+		// Radiance along a ray whose closest hit is already known (nullptr if the ray escaped)
+		RGB Li(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, MemoryArena& arena, RNG& rng) const;
+
+		// Spectral radiance at the sampled wavelengths along a ray whose closest hit is already known
+		SampledSpectrum Li(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, const SampledWavelengths& lambda,
+			MemoryArena& arena, RNG& rng) const;
+
+	protected:
+		// Radiance along a path; emission(i) gives the emitted radiance of the i-th light in the Spectrum type and fromRGB
+		// converts other RGB radiance, such as the environment light's
+		template <typename Spectrum, typename Emission, typename FromRGB>
+		Spectrum TracePath(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, const Emission& emission,
+			const FromRGB& fromRGB, MemoryArena& arena, RNG& rng) const;
+
+		// RGB radiance of one camera sample; samples wavelengths first in spectral mode
+		RGB SampleLi(const RayDifferential& ray, const SurfaceInteraction* firstHit, const Scene& scene, MemoryArena& arena, RNG& rng) const;
+
+		// Render the pixel block [pMin, pMax) one sample at a time, tracing the primary rays as a packet
+		void RenderPacketBlock(const Scene& scene, const Point2i& pMin, const Point2i& pMax, MemoryArena& arena);
+
+		const Camera& camera;
+		Film& film;
+		const int samplesPerPixel;
+		// Maximum number of bounces (0 means direct lighting only)
+		const int maxDepth;
+		// Width and height of primary ray packets
+		const int packetSize;
+		// Trace NSpectrumSamples wavelengths per path instead of RGB
+		const bool spectral;
+};
+
+}
+
+#endif
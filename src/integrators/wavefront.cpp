@@ -0,0 +1,414 @@
+#include "wavefront.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace apollo {
+
+// Work granularity of the parallel kernels
+static constexpr int KernelChunkSize = 4096;
+
+// Lights whose shadow rays are queued per path and pass when every light is sampled; bounds the shadow queue to a
+// fixed multiple of the path count whatever the number of lights
+static constexpr size_t LightsPerPass = 4;
+
+// Spread the lower 10 bits of x so that there are two zero bits between each of them
+static inline uint32_t LeftShift3(uint32_t x) {
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+// Interleave the bits of the three coordinates into a Morton code
+static inline uint32_t EncodeMorton3(uint32_t x, uint32_t y, uint32_t z) {
+	return (LeftShift3(z) << 2) | (LeftShift3(y) << 1) | LeftShift3(x);
+}
+
+// Gather the elements of v in the given order
+template <typename T> static void Reorder(std::vector<T>& v, const std::vector<uint32_t>& order, std::vector<T>& scratch) {
+	scratch.resize(v.size());
+	for (size_t i = 0; i < order.size(); i++)
+		scratch[i] = v[order[i]];
+	v.swap(scratch);
+}
+
+// Move the flagged elements of v to the front and drop the rest
+template <typename T> static void Compact(std::vector<T>& v, const std::vector<uint8_t>& keep) {
+	size_t n = 0;
+	for (size_t i = 0; i < v.size(); i++)
+		if (keep[i])
+			v[n++] = v[i];
+	v.resize(n);
+}
+
+// Wavefront Queues
+// ================
+
+void RayQueue::Resize(size_t n) {
+	for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tMax, &time, &betaR, &betaG, &betaB, &pdf })
+		v->resize(n);
+	pixel.resize(n);
+	sample.resize(n);
+}
+
+Ray RayQueue::GetRay(size_t i) const {
+	return Ray(Point3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i]), tMax[i], time[i]);
+}
+
+void RayQueue::SetRay(size_t i, const Ray& r) {
+	ox[i] = r.o.x; oy[i] = r.o.y; oz[i] = r.o.z;
+	dx[i] = r.d.x; dy[i] = r.d.y; dz[i] = r.d.z;
+	tMax[i] = r.tMax;
+	time[i] = r.time;
+}
+
+void RayQueue::Permute(const std::vector<uint32_t>& order) {
+	std::vector<float> floatScratch;
+	for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tMax, &time, &betaR, &betaG, &betaB, &pdf })
+		Reorder(*v, order, floatScratch);
+
+	std::vector<int> intScratch;
+	Reorder(pixel, order, intScratch);
+	Reorder(sample, order, intScratch);
+}
+
+void RayQueue::Compact(const std::vector<uint8_t>& keep) {
+	for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tMax, &time, &betaR, &betaG, &betaB, &pdf })
+		apollo::Compact(*v, keep);
+	apollo::Compact(pixel, keep);
+	apollo::Compact(sample, keep);
+}
+
+void HitQueue::Resize(size_t n) {
+	hit.resize(n);
+	for (std::vector<float>* v : { &px, &py, &pz, &ex, &ey, &ez, &nx, &ny, &nz })
+		v->resize(n);
+}
+
+void ShadowRayQueue::Resize(size_t n) {
+	for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tMax, &time, &Lr, &Lg, &Lb })
+		v->resize(n);
+	pixel.resize(n);
+	unoccluded.resize(n);
+}
+
+Ray ShadowRayQueue::GetRay(size_t i) const {
+	return Ray(Point3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i]), tMax[i], time[i]);
+}
+
+void ShadowRayQueue::SetRay(size_t i, const Ray& r) {
+	ox[i] = r.o.x; oy[i] = r.o.y; oz[i] = r.o.z;
+	dx[i] = r.d.x; dy[i] = r.d.y; dz[i] = r.d.z;
+	tMax[i] = r.tMax;
+	time[i] = r.time;
+}
+
+void ShadowRayQueue::Compact(const std::vector<uint8_t>& keep) {
+	for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tMax, &time, &Lr, &Lg, &Lb })
+		apollo::Compact(*v, keep);
+	apollo::Compact(pixel, keep);
+	unoccluded.resize(pixel.size());
+}
+
+// Wavefront path tracer
+// =====================
+
+WavefrontIntegrator::WavefrontIntegrator(const Camera& camera, Film& film, int samplesPerPixel, int maxDepth, int maxQueueSize)
+	: camera(camera), film(film), samplesPerPixel(samplesPerPixel), maxDepth(maxDepth), maxQueueSize(maxQueueSize) {}
+
+// Render the scene into the film
+void WavefrontIntegrator::Render(const Scene& scene) {
+	STAT_PHASE(Render);
+	TRACE_SCOPE("Render", "render");
+	const Point2i res = film.resolution;
+	const int nPixels = res.x * res.y;
+	const int64_t totalPaths = (int64_t)nPixels * samplesPerPixel;
+
+	std::vector<RGBA> radiance(nPixels);
+	RayQueue queue, nextQueue;
+	HitQueue hits;
+	ShadowRayQueue shadowQueue;
+
+	// Process the paths in batches of at most maxQueueSize, advancing the whole batch one bounce per iteration
+	for (int64_t firstPath = 0; firstPath < totalPaths; firstPath += maxQueueSize) {
+		int nPaths = (int)std::min<int64_t>(maxQueueSize, totalPaths - firstPath);
+		GenerateCameraRays(firstPath, nPaths, queue);
+
+		for (int depth = 0; queue.Size() > 0; depth++) {
+			SortRays(queue, scene.WorldBound());
+			IntersectClosest(scene, queue, depth, hits);
+			if (scene.environmentLight)
+				AddEscapedRadiance(scene, queue, hits, radiance);
+			Shade(scene, queue, hits, depth, shadowQueue, nextQueue);
+			TraceShadowRays(scene, shadowQueue, radiance);
+
+			// Without a light sampler every light contributes, a few lights per pass
+			if (!scene.GetLightSampler()) {
+				for (size_t firstLight = 0; firstLight < scene.lights.size(); firstLight += LightsPerPass) {
+					ShadeLights(scene, queue, hits, firstLight, std::min(firstLight + LightsPerPass, scene.lights.size()), shadowQueue);
+					TraceShadowRays(scene, shadowQueue, radiance);
+				}
+			}
+			std::swap(queue, nextQueue);
+		}
+	}
+
+	// Store the pixel estimates in the film
+	for (int y = 0; y < res.y; y++)
+		for (int x = 0; x < res.x; x++)
+			film.GetPixel(Point2i(x, y)) = (radiance[y * res.x + x] / (float)samplesPerPixel).ToRGB();
+}
+
+// Generate camera rays for paths [firstPath, firstPath + nPaths)
+void WavefrontIntegrator::GenerateCameraRays(int64_t firstPath, int nPaths, RayQueue& queue) const {
+	TRACE_SCOPE("Generate", "wavefront");
+
+	queue.Resize(nPaths);
+	const int width = film.resolution.x;
+
+	ParallelFor([&](int64_t i) {
+		int64_t path = firstPath + i;
+		int pixel = (int)(path / samplesPerPixel);
+		int sample = (int)(path % samplesPerPixel);
+
+		// Jitter the sample over the pixel area
+		RNG rng = PathRNG(pixel, sample, -1);
+		queue.SetRay(i, camera.GenerateRay(SampleCamera(Point2i(pixel % width, pixel / width), rng)));
+		queue.betaR[i] = queue.betaG[i] = queue.betaB[i] = 1.0f;
+		queue.pdf[i] = 0.0f;
+		queue.pixel[i] = pixel;
+		queue.sample[i] = sample;
+	}, nPaths, KernelChunkSize);
+}
+
+// Sort rays by origin cell within the scene bounds and by direction octant
+void WavefrontIntegrator::SortRays(RayQueue& queue, const Bounds3f& bounds) const {
+	TRACE_SCOPE("Sort", "wavefront");
+
+	// Origins are quantized onto a 2^9 grid per axis; together with the octant the key fits into 30 bits
+	constexpr int gridResolution = 1 << 9;
+	const size_t n = queue.Size();
+	const Vector3f extent = bounds.Diagonal();
+
+	// Sort key in the upper 32 bits and queue index in the lower 32 bits
+	std::vector<uint64_t> keys(n);
+	ParallelFor([&](int64_t i) {
+		const float o[3] = { queue.ox[i], queue.oy[i], queue.oz[i] };
+		uint32_t cell[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float t = extent[axis] > 0 ? (o[axis] - bounds.pMin[axis]) / extent[axis] : 0.0f;
+			cell[axis] = (uint32_t)Clamp((int)(t * gridResolution), 0, gridResolution - 1);
+		}
+
+		uint32_t octant = (queue.dx[i] < 0) | ((queue.dy[i] < 0) << 1) | ((queue.dz[i] < 0) << 2);
+		uint64_t key = ((uint64_t)EncodeMorton3(cell[0], cell[1], cell[2]) << 3) | octant;
+		keys[i] = (key << 32) | (uint64_t)i;
+	}, n, KernelChunkSize);
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> order(n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = (uint32_t)keys[i];
+	queue.Permute(order);
+}
+
+// Find the closest hit of every queued ray
+void WavefrontIntegrator::IntersectClosest(const Scene& scene, const RayQueue& queue, int depth, HitQueue& hits) const {
+	TRACE_SCOPE("Intersect", "wavefront");
+
+	hits.Resize(queue.Size());
+	std::vector<PixelCost> costs(film.HasCostAOV() ? queue.Size() : 0);
+
+	ParallelFor([&](int64_t i) {
+		SurfaceInteraction surf;
+		{
+			PixelCostScope costScope(costs.empty() ? nullptr : &costs[i]);
+			hits.hit[i] = scene.Intersect(queue.GetRay(i), &surf);
+		}
+		if (depth == 0) {
+			STAT_INC(CameraRays);
+			if (hits.hit[i])
+				STAT_INC(CameraRayHits);
+		} else {
+			STAT_INC(IndirectRays);
+			if (hits.hit[i])
+				STAT_INC(IndirectRayHits);
+		}
+		if (!hits.hit[i])
+			return;
+
+		Normal3f n = ShadingNormal(surf);
+		hits.px[i] = surf.p().x; hits.py[i] = surf.p().y; hits.pz[i] = surf.p().z;
+		hits.ex[i] = surf.pError().x; hits.ey[i] = surf.pError().y; hits.ez[i] = surf.pError().z;
+		hits.nx[i] = n.x; hits.ny[i] = n.y; hits.nz[i] = n.z;
+	}, queue.Size(), KernelChunkSize);
+
+	AddPixelCosts(costs, queue.pixel);
+}
+
+// Add the environment radiance of the rays that left the scene to the pixels
+// Runs serially like the shadow ray accumulation, as several rays of the queue may belong to the same pixel
+void WavefrontIntegrator::AddEscapedRadiance(const Scene& scene, const RayQueue& queue, const HitQueue& hits, std::vector<RGBA>& radiance) const {
+	TRACE_SCOPE("Escaped", "wavefront");
+
+	for (size_t i = 0; i < queue.Size(); i++) {
+		if (hits.hit[i])
+			continue;
+		const RGB beta(queue.betaR[i], queue.betaG[i], queue.betaB[i]);
+		const RGB L = beta * EnvironmentEmission(*scene.environmentLight, queue.GetRay(i), queue.pdf[i]);
+		radiance[queue.pixel[i]] += RGBA(L.r, L.g, L.b, 0.0f);
+	}
+}
+
+// Interaction at the closest hit of queue entry i
+static Interaction QueuedHit(const RayQueue& queue, const HitQueue& hits, size_t i) {
+	return Interaction(Point3f(hits.px[i], hits.py[i], hits.pz[i]), Vector3f(hits.ex[i], hits.ey[i], hits.ez[i]),
+		Normal3f(hits.nx[i], hits.ny[i], hits.nz[i]), Vector3f(), queue.time[i]);
+}
+
+// Queue the shadow ray in slot s that adds L to the pixel if unoccluded
+static void SetShadowRay(ShadowRayQueue& shadowQueue, size_t s, const Ray& shadowRay, const RGB& L, int pixel) {
+	shadowQueue.SetRay(s, shadowRay);
+	shadowQueue.Lr[s] = L.r; shadowQueue.Lg[s] = L.g; shadowQueue.Lb[s] = L.b;
+	shadowQueue.pixel[s] = pixel;
+}
+
+// Compute direct lighting shadow rays and continuation rays for every hit
+void WavefrontIntegrator::Shade(const Scene& scene, const RayQueue& queue, const HitQueue& hits, int depth,
+	ShadowRayQueue& shadowQueue, RayQueue& nextQueue) const {
+	TRACE_SCOPE("Shade", "wavefront");
+
+	const size_t n = queue.Size();
+	const LightSampler* lightSampler = scene.GetLightSampler();
+	const EnvironmentLight* environmentLight = scene.environmentLight.get();
+
+	// Every ray owns a shadow ray slot for the light picked by the light sampler, one for the environment light and
+	// one continuation slot; unused slots are compacted away afterwards. Without a light sampler, ShadeLights queues
+	// the shadow rays of all lights
+	const size_t nSlots = 2;
+	shadowQueue.Resize(n * nSlots);
+	nextQueue.Resize(n);
+	std::vector<uint8_t> keepShadow(n * nSlots, 0), keepNext(n, 0);
+
+	ParallelFor([&](int64_t i) {
+		if (!hits.hit[i])
+			return;
+
+		const Interaction it = QueuedHit(queue, hits, i);
+		const Normal3f& nrm = it.n();
+		const RGB beta(queue.betaR[i], queue.betaG[i], queue.betaB[i]);
+		RNG rng = PathRNG(queue.pixel[i], queue.sample[i], depth);
+
+		// Direct lighting from the sampled light, divided by the probability of having chosen it
+		SampledLight sampled;
+		if (lightSampler && lightSampler->Sample(it.p(), nrm, rng.UniformFloat(), &sampled)) {
+			RGB Ld;
+			Ray shadowRay;
+			if (SampleLightContribution(*scene.lights[sampled.index], it, nrm, &Ld, &shadowRay)) {
+				SetShadowRay(shadowQueue, i * nSlots, shadowRay, beta * Ld / sampled.p, queue.pixel[i]);
+				keepShadow[i * nSlots] = 1;
+			}
+		}
+
+		if (environmentLight) {
+			RGB Ld;
+			Ray shadowRay;
+			const Point2f u(rng.UniformFloat(), rng.UniformFloat());
+			if (SampleEnvironmentContribution(*environmentLight, it, nrm, u, depth < maxDepth, &Ld, &shadowRay)) {
+				SetShadowRay(shadowQueue, i * nSlots + 1, shadowRay, beta * Ld, queue.pixel[i]);
+				keepShadow[i * nSlots + 1] = 1;
+			}
+		}
+
+		if (depth == maxDepth)
+			return;
+
+		// Continue the path in a cosine-weighted direction; f * cos / pdf reduces to the albedo
+		Vector3f wi = SampleDiffuseBounce(nrm, Point2f(rng.UniformFloat(), rng.UniformFloat()));
+		nextQueue.SetRay(i, it.SpawnRay(wi));
+		nextQueue.betaR[i] = beta.r * DiffuseAlbedo;
+		nextQueue.betaG[i] = beta.g * DiffuseAlbedo;
+		nextQueue.betaB[i] = beta.b * DiffuseAlbedo;
+		nextQueue.pdf[i] = CosineHemispherePdf(Dot(wi, nrm));
+		nextQueue.pixel[i] = queue.pixel[i];
+		nextQueue.sample[i] = queue.sample[i];
+		keepNext[i] = 1;
+	}, n, KernelChunkSize);
+
+	shadowQueue.Compact(keepShadow);
+	nextQueue.Compact(keepNext);
+}
+
+// Compute the shadow rays of lights [firstLight, lastLight) for every hit
+void WavefrontIntegrator::ShadeLights(const Scene& scene, const RayQueue& queue, const HitQueue& hits, size_t firstLight, size_t lastLight,
+	ShadowRayQueue& shadowQueue) const {
+	TRACE_SCOPE("Shade lights", "wavefront");
+
+	const size_t n = queue.Size();
+	const size_t nSlots = lastLight - firstLight;
+	shadowQueue.Resize(n * nSlots);
+	std::vector<uint8_t> keepShadow(n * nSlots, 0);
+
+	ParallelFor([&](int64_t i) {
+		if (!hits.hit[i])
+			return;
+
+		const Interaction it = QueuedHit(queue, hits, i);
+		const RGB beta(queue.betaR[i], queue.betaG[i], queue.betaB[i]);
+		for (size_t l = firstLight; l < lastLight; l++) {
+			RGB Ld;
+			Ray shadowRay;
+			if (SampleLightContribution(*scene.lights[l], it, it.n(), &Ld, &shadowRay)) {
+				const size_t s = i * nSlots + (l - firstLight);
+				SetShadowRay(shadowQueue, s, shadowRay, beta * Ld, queue.pixel[i]);
+				keepShadow[s] = 1;
+			}
+		}
+	}, n, KernelChunkSize);
+
+	shadowQueue.Compact(keepShadow);
+}
+
+// Trace shadow rays and add the radiance of the unoccluded ones to the pixels
+void WavefrontIntegrator::TraceShadowRays(const Scene& scene, ShadowRayQueue& shadowQueue, std::vector<RGBA>& radiance) const {
+	TRACE_SCOPE("Shadow", "wavefront");
+
+	std::vector<PixelCost> costs(film.HasCostAOV() ? shadowQueue.Size() : 0);
+
+	ParallelFor([&](int64_t i) {
+		{
+			PixelCostScope costScope(costs.empty() ? nullptr : &costs[i]);
+			shadowQueue.unoccluded[i] = !scene.IntersectP(shadowQueue.GetRay(i));
+		}
+		STAT_INC(ShadowRays);
+		if (!shadowQueue.unoccluded[i])
+			STAT_INC(ShadowRaysOccluded);
+	}, shadowQueue.Size(), KernelChunkSize);
+
+	// Accumulate serially, several shadow rays may belong to the same pixel
+	for (size_t i = 0; i < shadowQueue.Size(); i++)
+		if (shadowQueue.unoccluded[i])
+			radiance[shadowQueue.pixel[i]] += RGBA(shadowQueue.Lr[i], shadowQueue.Lg[i], shadowQueue.Lb[i], 0.0f);
+
+	AddPixelCosts(costs, shadowQueue.pixel);
+}
+
+// Random number stream of a path at a given depth (-1 is used for camera ray generation)
+RNG WavefrontIntegrator::PathRNG(int pixel, int sample, int depth) const {
+	uint64_t path = (uint64_t)pixel * samplesPerPixel + sample;
+	return RNG(path * (maxDepth + 2) + (depth + 1));
+}
+
+// Charge the per-ray costs of a kernel to the pixels of the cost AOV
+// Only the traversal kernels are measured, since they account for nearly all of the per-pixel variation
+void WavefrontIntegrator::AddPixelCosts(const std::vector<PixelCost>& costs, const std::vector<int>& pixels) const {
+	const int width = film.resolution.x;
+	for (size_t i = 0; i < costs.size(); i++)
+		film.GetPixelCost(Point2i(pixels[i] % width, pixels[i] / width)) += costs[i];
+}
+
+}
@@ -0,0 +1,121 @@
+#ifndef APOLLO_INTEGRATORS_WAVEFRONT_H
+#define APOLLO_INTEGRATORS_WAVEFRONT_H
+
+#include "apollo.h"
+#include "integrator.h"
+
+namespace apollo {
+
+// Wavefront Queues
+// ================
+
+// Structure-of-arrays queue of path segments processed together by the wavefront kernels
+struct RayQueue {
+	size_t Size() const { return pixel.size(); }
+	void Resize(size_t n);
+
+	// Read and write a single ray
+	Ray GetRay(size_t i) const;
+	void SetRay(size_t i, const Ray& r);
+
+	// Reorder the queue so that entry i becomes the former entry order[i]
+	void Permute(const std::vector<uint32_t>& order);
+
+	// Keep only the entries whose flag is set, preserving their order
+	void Compact(const std::vector<uint8_t>& keep);
+
+	// Ray origin, direction, extent and time
+	std::vector<float> ox, oy, oz, dx, dy, dz, tMax, time;
+	// Path throughput
+	std::vector<float> betaR, betaG, betaB;
+	// Density the direction was sampled with by the last bounce (0 for camera rays)
+	std::vector<float> pdf;
+	// Pixel and pixel sample the path contributes to
+	std::vector<int> pixel, sample;
+};
+
+// Closest hits of the entries of a RayQueue
+struct HitQueue {
+	void Resize(size_t n);
+
+	std::vector<uint8_t> hit;
+	// Hit point, its rounding error bound and normalized normal facing the incoming ray
+	std::vector<float> px, py, pz, ex, ey, ez, nx, ny, nz;
+};
+
+// Shadow rays together with the radiance they deliver if unoccluded
+struct ShadowRayQueue {
+	size_t Size() const { return pixel.size(); }
+	void Resize(size_t n);
+
+	// Read and write a single ray
+	Ray GetRay(size_t i) const;
+	void SetRay(size_t i, const Ray& r);
+
+	// Keep only the entries whose flag is set, preserving their order
+	void Compact(const std::vector<uint8_t>& keep);
+
+	// Ray origin, direction, extent and time
+	std::vector<float> ox, oy, oz, dx, dy, dz, tMax, time;
+	// Radiance added to the pixel if the ray is unoccluded
+	std::vector<float> Lr, Lg, Lb;
+	std::vector<int> pixel;
+	std::vector<uint8_t> unoccluded;
+};
+
+// Wavefront path tracer
+// Large batches of paths advance one bounce at a time: every stage (generate, sort, intersect, shade, shadow) 
+// runs as a bulk kernel over the whole batch. Rays are sorted by origin cell and direction octant before traversal, 
+// so consecutive rays visit the same BVH nodes while they are still in cache
+class WavefrontIntegrator : public Integrator {
+	public:
+		WavefrontIntegrator(const Camera& camera, Film& film, int samplesPerPixel, int maxDepth, int maxQueueSize = 1 << 20);
+
+		// Render the scene into the film
+		void Render(const Scene& scene) override;
+
+	private:
+		// Wavefront kernels
+		// =================
+
+		// Generate camera rays for paths [firstPath, firstPath + nPaths)
+		void GenerateCameraRays(int64_t firstPath, int nPaths, RayQueue& queue) const;
+
+		// Sort rays by origin cell within the scene bounds and by direction octant
+		void SortRays(RayQueue& queue, const Bounds3f& bounds) const;
+
+		// Find the closest hit of every queued ray (depth 0 holds camera rays)
+		void IntersectClosest(const Scene& scene, const RayQueue& queue, int depth, HitQueue& hits) const;
+
+		// Add the environment radiance of the rays that left the scene to the pixels
+		void AddEscapedRadiance(const Scene& scene, const RayQueue& queue, const HitQueue& hits, std::vector<RGBA>& radiance) const;
+
+		// Compute continuation rays and the shadow rays of the sampled light and the environment light for every hit
+		void Shade(const Scene& scene, const RayQueue& queue, const HitQueue& hits, int depth,
+			ShadowRayQueue& shadowQueue, RayQueue& nextQueue) const;
+
+		// Compute the shadow rays of lights [firstLight, lastLight) for every hit, when all lights are sampled
+		void ShadeLights(const Scene& scene, const RayQueue& queue, const HitQueue& hits, size_t firstLight, size_t lastLight,
+			ShadowRayQueue& shadowQueue) const;
+
+		// Trace shadow rays and add the radiance of the unoccluded ones to the pixels
+		void TraceShadowRays(const Scene& scene, ShadowRayQueue& shadowQueue, std::vector<RGBA>& radiance) const;
+
+		// Random number stream of a path at a given depth
+		RNG PathRNG(int pixel, int sample, int depth) const;
+
+		// Charge the per-ray costs of a kernel to the pixels of the cost AOV
+		void AddPixelCosts(const std::vector<PixelCost>& costs, const std::vector<int>& pixels) const;
+
+		const Camera& camera;
+		Film& film;
+		const int samplesPerPixel;
+		// Maximum number of bounces (0 means direct lighting only)
+		const int maxDepth;
+		// Maximum number of paths in flight at once
+		const int maxQueueSize;
+};
+
+}
+
+#endif
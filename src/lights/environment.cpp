@@ -0,0 +1,98 @@
+#include "environment.h"
+#include "imageio.h"
+#include "parallel.h"
+#include "trace.h"
+#include "transformcache.h"
+
+namespace apollo {
+
+// Environment Light
+// =================
+
+// The distribution is built at the image resolution; every pixel is weighted by the sine of its polar angle, since rows
+// near the poles cover less solid angle. Lookups return the same constant pixel values, so the sampled density follows
+// the radiance exactly
+EnvironmentLight::EnvironmentLight(const Transform* lightToWorld, const Transform* worldToLight, std::vector<RGB> image,
+	const Point2i& resolution, float scale)
+	: lightToWorld(lightToWorld), worldToLight(worldToLight), image(std::move(image)), resolution(resolution), scale(scale) {
+	TRACE_SCOPE("Build environment distribution", "build");
+
+	std::vector<float> func((size_t)resolution.x * resolution.y);
+	ParallelFor([&](int64_t y) {
+		const float sinTheta = std::sin(PI * (y + 0.5f) / resolution.y);
+		for (int x = 0; x < resolution.x; x++) {
+			const RGB& c = this->image[y * resolution.x + x];
+			func[y * resolution.x + x] = (c.r + c.g + c.b) / 3 * sinTheta;
+		}
+	}, resolution.y, 16);
+
+	distribution.reset(new Distribution2D(func.data(), resolution.x, resolution.y));
+}
+
+Point2f EnvironmentLight::DirectionToUV(const Vector3f& w) {
+	const float theta = SafeACos(w.y);
+	float phi = std::atan2(w.z, w.x);
+	if (phi < 0.0f)
+		phi += 2 * PI;
+	return Point2f(phi / (2 * PI), theta / PI);
+}
+
+Vector3f EnvironmentLight::UVToDirection(const Point2f& uv) {
+	const float phi = uv.x * 2 * PI, theta = uv.y * PI;
+	const float sinTheta = std::sin(theta);
+	return Vector3f(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+}
+
+RGB EnvironmentLight::Lookup(const Point2f& uv) const {
+	const int x = Clamp((int)(uv.x * resolution.x), 0, resolution.x - 1);
+	const int y = Clamp((int)(uv.y * resolution.y), 0, resolution.y - 1);
+	return image[y * resolution.x + x] * scale;
+}
+
+// Radiance arriving along -w
+RGB EnvironmentLight::Le(const Vector3f& w) const {
+	return Lookup(DirectionToUV((*worldToLight)(w).Normalized()));
+}
+
+// Sample image coordinates from the distribution and convert their density from the unit square to solid angle, where
+// the mapping stretches a pixel by 2 * PI * PI * sin(theta)
+RGB EnvironmentLight::Sample(const Point2f& u, Vector3f* wi, float* pdf) const {
+	float uvPdf;
+	const Point2f uv = distribution->SampleContinuous(u, &uvPdf);
+	const float sinTheta = std::sin(uv.y * PI);
+	if (uvPdf == 0.0f || sinTheta == 0.0f) {
+		*pdf = 0.0f;
+		return RGB(0.0f);
+	}
+
+	*wi = (*lightToWorld)(UVToDirection(uv)).Normalized();
+	*pdf = uvPdf / (2 * PI * PI * sinTheta);
+	return Lookup(uv);
+}
+
+// Solid angle density of sampling the direction w
+float EnvironmentLight::Pdf(const Vector3f& w) const {
+	const Point2f uv = DirectionToUV((*worldToLight)(w).Normalized());
+	const float sinTheta = std::sin(uv.y * PI);
+	if (sinTheta == 0.0f)
+		return 0.0f;
+	return distribution->Pdf(uv) / (2 * PI * PI * sinTheta);
+}
+
+// Environment light of a .pfm or .hdr image file
+std::shared_ptr<EnvironmentLight> CreateEnvironmentLight(const Transform* lightToWorld, const Transform* worldToLight, const std::string& filename,
+	float scale) {
+	std::vector<RGB> image;
+	Point2i resolution;
+	if (!ReadImage(filename, &image, &resolution))
+		return nullptr;
+	return std::make_shared<EnvironmentLight>(lightToWorld, worldToLight, std::move(image), resolution, scale);
+}
+
+std::shared_ptr<EnvironmentLight> CreateEnvironmentLight(const Transform& lightToWorld, const std::string& filename, float scale) {
+	const Transform *toWorld, *toLight;
+	transformCache.Lookup(lightToWorld, &toWorld, &toLight);
+	return CreateEnvironmentLight(toWorld, toLight, filename, scale);
+}
+
+}
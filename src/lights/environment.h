@@ -0,0 +1,57 @@
+#ifndef APOLLO_LIGHTS_ENVIRONMENT_H
+#define APOLLO_LIGHTS_ENVIRONMENT_H
+
+#include "apollo.h"
+#include "transform.h"
+#include "rgb.h"
+#include "point2.h"
+#include "sampling.h"
+
+namespace apollo {
+
+// Infinitely distant light surrounding the scene, with the radiance of an equirectangular (latitude-longitude) image
+// In light space +y points to the top row of the image and the left column lies towards +x, with u increasing towards +z
+// Directions are sampled from a piecewise-constant distribution over the pixels, proportional to their brightness
+// times the solid angle they cover, so bright regions such as the sun get their share of the samples
+class EnvironmentLight {
+	public:
+		// Light of an image given as rows of pixels from the top, scaled by scale
+		EnvironmentLight(const Transform* lightToWorld, const Transform* worldToLight, std::vector<RGB> image, const Point2i& resolution,
+			float scale = 1.0f);
+
+		// Radiance arriving along -w, for a ray with direction w that left the scene
+		RGB Le(const Vector3f& w) const;
+
+		// Sample a direction wi towards the light; returns the radiance arriving from it and its solid angle density
+		RGB Sample(const Point2f& u, Vector3f* wi, float* pdf) const;
+
+		// Solid angle density of sampling the direction w
+		float Pdf(const Vector3f& w) const;
+
+	public:
+		const Transform *lightToWorld, *worldToLight;
+	private:
+		// Image coordinates in [0, 1)^2 of a light space direction and vice versa
+		static Point2f DirectionToUV(const Vector3f& w);
+		static Vector3f UVToDirection(const Point2f& uv);
+
+		// Pixel of the image containing the image coordinates
+		RGB Lookup(const Point2f& uv) const;
+
+		std::vector<RGB> image;
+		Point2i resolution;
+		float scale;
+		std::unique_ptr<Distribution2D> distribution;
+};
+
+// Environment light of a .pfm or .hdr image file; returns nullptr if the image cannot be read
+std::shared_ptr<EnvironmentLight> CreateEnvironmentLight(const Transform* lightToWorld, const Transform* worldToLight, const std::string& filename,
+	float scale = 1.0f);
+
+// Same as above, with the transform and its inverse shared through the transform cache
+std::shared_ptr<EnvironmentLight> CreateEnvironmentLight(const Transform& lightToWorld, const std::string& filename,
+	float scale = 1.0f);
+
+}
+
+#endif
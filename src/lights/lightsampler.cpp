@@ -0,0 +1,231 @@
+#include "lightsampler.h"
+#include "rng.h"
+#include "trace.h"
+
+namespace apollo {
+
+// Power Light Sampling
+// ====================
+
+PowerLightSampler::PowerLightSampler(const std::vector<std::shared_ptr<Light>>& lights) {
+	if (lights.empty())
+		return;
+
+	// Without any power to go by, the table falls back to choosing uniformly
+	std::vector<float> lightPower;
+	for (const std::shared_ptr<Light>& light : lights)
+		lightPower.push_back(light->Phi());
+	aliasTable = AliasTable(lightPower);
+}
+
+bool PowerLightSampler::Sample(const Point3f&, const Normal3f&, float u, SampledLight* sampled) const {
+	if (aliasTable.size() == 0)
+		return false;
+
+	float pmf;
+	const int index = aliasTable.Sample(u, &pmf);
+	*sampled = { (size_t)index, pmf };
+	return true;
+}
+
+float PowerLightSampler::PMF(const Point3f&, const Normal3f&, size_t index) const {
+	return aliasTable.size() == 0 ? 0.0f : aliasTable.PMF((int)index);
+}
+
+// Light BVH Construction
+// ======================
+
+BVHLightSampler::BVHLightSampler(const std::vector<std::shared_ptr<Light>>& lights)
+	: lightToBitTrail(lights.size(), NotInBVH) {
+	TRACE_SCOPE("Build light BVH", "build");
+
+	// Lights without power can never be chosen
+	std::vector<std::pair<int, LightBounds>> bvhLights;
+	for (size_t i = 0; i < lights.size(); i++) {
+		LightBounds lightBounds = lights[i]->Bounds();
+		if (lightBounds.phi > 0.0f)
+			bvhLights.push_back(std::make_pair((int)i, lightBounds));
+	}
+
+	if (!bvhLights.empty()) {
+		nodes.reserve(2 * bvhLights.size() - 1);
+		BuildBVH(bvhLights, 0, (int)bvhLights.size(), 0, 0);
+	}
+}
+
+// Split candidates are evaluated at bucket boundaries along every axis, as in the primitive BVH, but the cost also weighs
+// power and the spread of emission directions, so lights that point the same way end up together
+std::pair<int, LightBounds> BVHLightSampler::BuildBVH(std::vector<std::pair<int, LightBounds>>& bvhLights, int start, int end,
+	uint64_t bitTrail, int depth) {
+	if (end - start == 1) {
+		const int nodeIndex = (int)nodes.size();
+		nodes.push_back({ bvhLights[start].second, (uint32_t)bvhLights[start].first, true });
+		lightToBitTrail[bvhLights[start].first] = bitTrail;
+		return { nodeIndex, bvhLights[start].second };
+	}
+
+	Bounds3f bounds, centroidBounds;
+	for (int i = start; i < end; i++) {
+		bounds.Union(bvhLights[i].second.bounds);
+		centroidBounds.Union(bvhLights[i].second.Centroid());
+	}
+
+	// Bit trails hold one bit per level; near their end only balanced splits are guaranteed to fit
+	int levelsNeeded = 0;
+	while ((1 << levelsNeeded) < end - start)
+		levelsNeeded++;
+	const bool forceMedian = depth + levelsNeeded >= 63;
+
+	constexpr int nBuckets = 12;
+	auto bucketIndex = [&](const LightBounds& lb, int dim) {
+		int b = (int)(nBuckets * (lb.Centroid()[dim] - centroidBounds.pMin[dim]) / (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+		return std::min(b, nBuckets - 1);
+	};
+
+	float minCost = Infinity;
+	int minCostSplitBucket = -1, minCostSplitDim = -1;
+	for (int dim = 0; dim < 3 && !forceMedian; dim++) {
+		if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+			continue;
+
+		LightBounds bucketLightBounds[nBuckets];
+		for (int i = start; i < end; i++) {
+			LightBounds& bucket = bucketLightBounds[bucketIndex(bvhLights[i].second, dim)];
+			bucket = Union(bucket, bvhLights[i].second);
+		}
+
+		for (int i = 0; i < nBuckets - 1; i++) {
+			LightBounds b0, b1;
+			for (int j = 0; j <= i; j++)
+				b0 = Union(b0, bucketLightBounds[j]);
+			for (int j = i + 1; j < nBuckets; j++)
+				b1 = Union(b1, bucketLightBounds[j]);
+
+			const float cost = EvaluateCost(b0, bounds, dim) + EvaluateCost(b1, bounds, dim);
+			// Zero costs only come from buckets of single points and say nothing about the split
+			if (cost > 0.0f && cost < minCost) {
+				minCost = cost;
+				minCostSplitBucket = i;
+				minCostSplitDim = dim;
+			}
+		}
+	}
+
+	int mid;
+	if (minCostSplitDim == -1)
+		mid = (start + end) / 2;
+	else {
+		auto pMid = std::partition(&bvhLights[start], &bvhLights[end - 1] + 1, [&](const std::pair<int, LightBounds>& l) {
+			return bucketIndex(l.second, minCostSplitDim) <= minCostSplitBucket;
+		});
+		mid = (int)(pMid - &bvhLights[0]);
+		if (mid == start || mid == end)
+			mid = (start + end) / 2;
+	}
+
+	// Reserve the interior node before the children so that the first child directly follows it
+	const int nodeIndex = (int)nodes.size();
+	nodes.push_back(LightBVHNode());
+	const std::pair<int, LightBounds> child0 = BuildBVH(bvhLights, start, mid, bitTrail, depth + 1);
+	const std::pair<int, LightBounds> child1 = BuildBVH(bvhLights, mid, end, bitTrail | (1ULL << depth), depth + 1);
+
+	const LightBounds lightBounds = Union(child0.second, child1.second);
+	nodes[nodeIndex] = { lightBounds, (uint32_t)child1.first, false };
+	return { nodeIndex, lightBounds };
+}
+
+// M_omega integrates the emitted cosine-weighted solid angle over the orientation and emission cones; Kr penalizes
+// splitting thin boxes along their short axis
+float BVHLightSampler::EvaluateCost(const LightBounds& b, const Bounds3f& bounds, int dim) const {
+	const float theta_o = SafeACos(b.cosTheta_o), theta_e = SafeACos(b.cosTheta_e);
+	const float theta_w = std::min(theta_o + theta_e, PI);
+	const float sinTheta_o = SafeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+	const float M_omega = 2 * PI * (1 - b.cosTheta_o) +
+		PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sinTheta_o + b.cosTheta_o);
+
+	const Vector3f d = bounds.Diagonal();
+	const float Kr = std::max(d.x, std::max(d.y, d.z)) / d[dim];
+	return b.phi * M_omega * Kr * b.bounds.SurfaceArea();
+}
+
+// Light BVH Sampling
+// ==================
+
+bool BVHLightSampler::Sample(const Point3f& p, const Normal3f& n, float u, SampledLight* sampled) const {
+	if (nodes.empty())
+		return false;
+
+	int nodeIndex = 0;
+	float pmf = 1.0f;
+	while (true) {
+		const LightBVHNode& node = nodes[nodeIndex];
+		if (node.isLeaf) {
+			// A single light at the root has not been checked yet
+			if (nodeIndex > 0 || node.lightBounds.Importance(p, n) > 0.0f) {
+				*sampled = { node.childOrLightIndex, pmf };
+				return true;
+			}
+			return false;
+		}
+
+		// Pick a child in proportion to its importance and reuse the remainder of u further down
+		const float c0 = nodes[nodeIndex + 1].lightBounds.Importance(p, n);
+		const float c1 = nodes[node.childOrLightIndex].lightBounds.Importance(p, n);
+		if (c0 == 0.0f && c1 == 0.0f)
+			return false;
+
+		const float p0 = c0 / (c0 + c1);
+		if (u < p0) {
+			u = std::min(u / p0, OneMinusEpsilon);
+			pmf *= p0;
+			nodeIndex = nodeIndex + 1;
+		} else {
+			u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+			pmf *= 1 - p0;
+			nodeIndex = node.childOrLightIndex;
+		}
+	}
+}
+
+// Follow the light's bit trail from the root, multiplying the probabilities of the choices along it
+float BVHLightSampler::PMF(const Point3f& p, const Normal3f& n, size_t index) const {
+	uint64_t bitTrail = lightToBitTrail[index];
+	if (bitTrail == NotInBVH)
+		return 0.0f;
+
+	int nodeIndex = 0;
+	float pmf = 1.0f;
+	while (true) {
+		const LightBVHNode& node = nodes[nodeIndex];
+		if (node.isLeaf)
+			return nodeIndex > 0 || node.lightBounds.Importance(p, n) > 0.0f ? pmf : 0.0f;
+
+		const float c0 = nodes[nodeIndex + 1].lightBounds.Importance(p, n);
+		const float c1 = nodes[node.childOrLightIndex].lightBounds.Importance(p, n);
+		if (c0 == 0.0f && c1 == 0.0f)
+			return 0.0f;
+
+		if (bitTrail & 1) {
+			pmf *= c1 / (c0 + c1);
+			nodeIndex = node.childOrLightIndex;
+		} else {
+			pmf *= c0 / (c0 + c1);
+			nodeIndex = nodeIndex + 1;
+		}
+		bitTrail >>= 1;
+	}
+}
+
+// Create the sampler of a strategy (nullptr for LightSampling::All)
+std::unique_ptr<LightSampler> CreateLightSampler(LightSampling strategy, const std::vector<std::shared_ptr<Light>>& lights) {
+	switch (strategy) {
+		case LightSampling::Power:
+			return std::unique_ptr<LightSampler>(new PowerLightSampler(lights));
+		case LightSampling::BVH:
+			return std::unique_ptr<LightSampler>(new BVHLightSampler(lights));
+		default:
+			return nullptr;
+	}
+}
+
+}
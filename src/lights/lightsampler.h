@@ -0,0 +1,94 @@
+#ifndef APOLLO_LIGHTS_LIGHTSAMPLER_H
+#define APOLLO_LIGHTS_LIGHTSAMPLER_H
+
+#include "apollo.h"
+#include "light.h"
+#include "sampling.h"
+
+namespace apollo {
+
+// How integrators pick the lights that illuminate a shading point
+enum class LightSampling {
+	// Every light, each with its own shadow ray
+	All,
+	// One light chosen in proportion to its power, independent of the shading point
+	Power,
+	// One light chosen by traversing a light hierarchy
+	BVH
+};
+
+// Light chosen for a shading point: its index in the scene's lights and the probability it was chosen with
+struct SampledLight {
+	size_t index;
+	float p;
+};
+
+// Chooses a single light per shading point, so direct lighting costs one shadow ray however many lights there are
+class LightSampler {
+	public:
+		virtual ~LightSampler() {}
+
+		// Choose a light for point p on a surface facing n (a zero n for points not on a surface)
+		// Returns false if no light can illuminate the point
+		virtual bool Sample(const Point3f& p, const Normal3f& n, float u, SampledLight* sampled) const = 0;
+
+		// Probability that Sample chooses the light with the given index for the point
+		virtual float PMF(const Point3f& p, const Normal3f& n, size_t index) const = 0;
+};
+
+// Chooses lights in proportion to their emitted power from an alias table, in constant time per shading point
+// Cheaper than the light hierarchy for moderate light counts, but blind to distance and orientation
+class PowerLightSampler : public LightSampler {
+	public:
+		PowerLightSampler(const std::vector<std::shared_ptr<Light>>& lights);
+
+		bool Sample(const Point3f& p, const Normal3f& n, float u, SampledLight* sampled) const override;
+
+		float PMF(const Point3f& p, const Normal3f& n, size_t index) const override;
+
+	private:
+		AliasTable aliasTable;
+};
+
+// Node of the light hierarchy; stored in depth-first order so the first child directly follows its parent
+struct LightBVHNode {
+	LightBounds lightBounds;
+	// Leaf: index of the light, interior: offset of the second child
+	uint32_t childOrLightIndex;
+	bool isLeaf;
+};
+
+// Binary hierarchy over the lights' spatial and directional bounds
+// Sampling descends from the root and picks each child with probability proportional to the importance of its bounds for
+// the shading point, which takes O(log N) steps and concentrates samples on the lights that matter there. Lights that
+// cannot illuminate a point (facing away, too far off their emission cone, behind the surface) are never chosen
+class BVHLightSampler : public LightSampler {
+	public:
+		BVHLightSampler(const std::vector<std::shared_ptr<Light>>& lights);
+
+		bool Sample(const Point3f& p, const Normal3f& n, float u, SampledLight* sampled) const override;
+
+		float PMF(const Point3f& p, const Normal3f& n, size_t index) const override;
+
+	private:
+		// Recursively build the hierarchy over bvhLights[start, end); bitTrail records the path from the root
+		// (bit i set for taking the second child at depth i). Returns the node index and its bounds
+		std::pair<int, LightBounds> BuildBVH(std::vector<std::pair<int, LightBounds>>& bvhLights, int start, int end,
+			uint64_t bitTrail, int depth);
+
+		// Cost of a split candidate: power times the solid angle measure of the emission times the surface area
+		float EvaluateCost(const LightBounds& b, const Bounds3f& bounds, int dim) const;
+
+		std::vector<LightBVHNode> nodes;
+
+		// Path from the root to the leaf of every light (NotInBVH for lights without power)
+		std::vector<uint64_t> lightToBitTrail;
+		static constexpr uint64_t NotInBVH = ~0ULL;
+};
+
+// Create the sampler of a strategy (nullptr for LightSampling::All)
+std::unique_ptr<LightSampler> CreateLightSampler(LightSampling strategy, const std::vector<std::shared_ptr<Light>>& lights);
+
+}
+
+#endif
@@ -14,8 +14,8 @@ template <typename T> class Bounds3 {
 		Bounds3() {
 			T minNum = std::numeric_limits<T>::lowest();
 			T maxNum = std::numeric_limits<T>::max();
-			pMin(maxNum);
-			pMax(minNum);
+			pMin = Point3<T>(maxNum);
+			pMax = Point3<T>(minNum);
 		}
 
 		// Enclose a single point
@@ -36,7 +36,7 @@ template <typename T> class Bounds3 {
 		}
 
 		// Ray-Bounds3 intersection
-		bool Intersect(const Ray& r, float& t1, float& t2) {
+		bool Intersect(const Ray& r, float& t1, float& t2) const {
 			float tMin = 0;
 			float tMax = r.tMax;
 			
@@ -48,6 +48,9 @@ template <typename T> class Bounds3 {
 				if (invD < 0.0f)
 					std::swap(t0, t1);
 
+				// Widen the far distance by its rounding error so grazing rays are not lost
+				t1 *= 1 + 2 * Gamma(3);
+
 				tMin = t0 > tMin ? t0 : tMin;
 				tMax = t1 < tMax ? t1 : tMax;
 
@@ -60,6 +63,40 @@ template <typename T> class Bounds3 {
 			return true;
 		}
  
+		// Ray-Bounds3 intersection test using precomputed reciprocal direction and direction signs
+		bool IntersectP(const Ray& r, const Vector3f& invDir, const int dirIsNeg[3]) const {
+			const Bounds3<T> &b = *this;
+
+			// Check for ray intersection against x and y slabs
+			float tMin = (b[dirIsNeg[0]].x - r.o.x) * invDir.x;
+			float tMax = (b[1 - dirIsNeg[0]].x - r.o.x) * invDir.x;
+			float tyMin = (b[dirIsNeg[1]].y - r.o.y) * invDir.y;
+			float tyMax = (b[1 - dirIsNeg[1]].y - r.o.y) * invDir.y;
+
+			// Widen the far distances by their rounding error so grazing rays are not lost
+			tMax *= 1 + 2 * Gamma(3);
+			tyMax *= 1 + 2 * Gamma(3);
+			if (tMin > tyMax || tyMin > tMax)
+				return false;
+			if (tyMin > tMin)
+				tMin = tyMin;
+			if (tyMax < tMax)
+				tMax = tyMax;
+
+			// Check for ray intersection against z slab
+			float tzMin = (b[dirIsNeg[2]].z - r.o.z) * invDir.z;
+			float tzMax = (b[1 - dirIsNeg[2]].z - r.o.z) * invDir.z;
+			tzMax *= 1 + 2 * Gamma(3);
+			if (tMin > tzMax || tzMin > tMax)
+				return false;
+			if (tzMin > tMin)
+				tMin = tzMin;
+			if (tzMax < tMax)
+				tMax = tzMax;
+
+			return (tMin < r.tMax) && (tMax > 0);
+		}
+
 		// Enlarge bounding box to contain given point
 		Bounds3<T>& Union(const Point3<T> &p) {
 			pMin = Point3<T>(std::min(pMin.x, p.x), std::min(pMin.y, p.y), std::min(pMin.z, p.z));
@@ -69,7 +106,7 @@ template <typename T> class Bounds3 {
 
 		// Enlarge bounding box to contain given bounding box
 		Bounds3<T>& Union(const Bounds3<T> &b) {
-			pMin = Point3<T>(std::min(pMin.x, b.pMin.x), std::min(pMin.y, b.pMin.y), std::min(pMin.z, b.pMax.z));
+			pMin = Point3<T>(std::min(pMin.x, b.pMin.x), std::min(pMin.y, b.pMin.y), std::min(pMin.z, b.pMin.z));
 			pMax = Point3<T>(std::max(pMax.x, b.pMax.x), std::max(pMax.y, b.pMax.y), std::max(pMax.z, b.pMax.z));
 			return *this;
 		}
@@ -1,13 +1,17 @@
 #include "interaction.h"
+#include "bsdf.h"
+#include "memory.h"
 
 namespace apollo {
 	
-	Interaction::Interaction(const Point3f &p, const Normal3f &n, const Vector3f &wo, float time) 
-				: _p(p), _n(n), _wo(wo), _time(time) {}
+	Interaction::Interaction(const Point3f &p, const Vector3f &pError, const Normal3f &n, const Vector3f &wo, float time) 
+				: _p(p), _pError(pError), _time(time), _wo(wo), _n(n) {}
 	
 	// Accessor methods
 	const Point3f& Interaction::p() const { return _p; }
 	Point3f& Interaction::p() { return _p; }
+	const Vector3f& Interaction::pError() const { return _pError; }
+	Vector3f& Interaction::pError() { return _pError; }
 	const float& Interaction::time() const { return _time; }
 	float& Interaction::time() { return _time; }
 	const Vector3f& Interaction::wo() const { return _wo; }
@@ -15,9 +19,20 @@ namespace apollo {
 	const Normal3f& Interaction::n() const { return _n; }
 	Normal3f& Interaction::n() { return _n; }
 
-	SurfaceInteraction::SurfaceInteraction(const Point3f& p, const Normal3f& n, const Point2f& uv, const Vector3f& wo,          
-		float time, const Shape *shape) : Interaction(p, n, wo, time),
-		_uv(uv), shape(shape) {
+	// Spawn a ray leaving the surface in direction d
+	Ray Interaction::SpawnRay(const Vector3f& d) const {
+		return Ray(OffsetRayOrigin(_p, _pError, _n, d), d, Infinity, _time);
+	}
+
+	// Spawn a ray towards p2 that stops just short of it
+	Ray Interaction::SpawnRayTo(const Point3f& p2) const {
+		Point3f o = OffsetRayOrigin(_p, _pError, _n, p2 - _p);
+		return Ray(o, p2 - o, 1 - ShadowEpsilon, _time);
+	}
+
+	SurfaceInteraction::SurfaceInteraction(const Point3f& p, const Vector3f& pError, const Normal3f& n, const Point2f& uv, const Vector3f& dpdu,
+		const Vector3f& dpdv, const Normal3f& dndu, const Normal3f& dndv, const Vector3f& wo, float time, const Shape *shape)
+		: Interaction(p, pError, n, wo, time), _uv(uv), shape(shape), dpdu(dpdu), dpdv(dpdv), dndu(dndu), dndv(dndv) {
 		// Swap normal direction if shape has reverse orientation or 
 		// object to world transformation changes coordinate system handedness
 		if (shape && (shape->reverseOrientation ^ shape->transformChangesHandedness))
@@ -27,4 +42,74 @@ namespace apollo {
 	// Accessor methods
 	const Point2f& SurfaceInteraction::uv() const { return _uv; }
 	Point2f& SurfaceInteraction::uv() { return _uv; }
+
+	// Estimate the screen space derivatives of p and (u, v)
+	void SurfaceInteraction::ComputeDifferentials(const RayDifferential& ray) {
+		dpdx = dpdy = Vector3f(0.0f);
+		dudx = dvdx = dudy = dvdy = 0.0f;
+		if (!ray.hasDifferentials)
+			return;
+
+		// Intersect the auxiliary rays with the tangent plane of the point
+		Normal3f n = _n.Normalized();
+		float d = n.x * _p.x + n.y * _p.y + n.z * _p.z;
+		float tx = (d - (n.x * ray.rxOrigin.x + n.y * ray.rxOrigin.y + n.z * ray.rxOrigin.z)) / Dot(n, ray.rxDirection);
+		float ty = (d - (n.x * ray.ryOrigin.x + n.y * ray.ryOrigin.y + n.z * ray.ryOrigin.z)) / Dot(n, ray.ryDirection);
+		if (!std::isfinite(tx) || !std::isfinite(ty))
+			return;
+		dpdx = (ray.rxOrigin + ray.rxDirection * tx) - _p;
+		dpdy = (ray.ryOrigin + ray.ryDirection * ty) - _p;
+
+		// Solve dp = dpdu * du + dpdv * dv in the two coordinates the normal is least aligned with
+		int dim0 = 0, dim1 = 1;
+		if (std::abs(n.x) > std::abs(n.y) && std::abs(n.x) > std::abs(n.z))
+			dim0 = 1, dim1 = 2;
+		else if (std::abs(n.y) > std::abs(n.z))
+			dim1 = 2;
+
+		float a00 = dpdu[dim0], a01 = dpdv[dim0], a10 = dpdu[dim1], a11 = dpdv[dim1];
+		float det = a00 * a11 - a01 * a10;
+		if (std::abs(det) < 1e-10f)
+			return;
+		float invDet = 1 / det;
+		dudx = (a11 * dpdx[dim0] - a01 * dpdx[dim1]) * invDet;
+		dvdx = (a00 * dpdx[dim1] - a10 * dpdx[dim0]) * invDet;
+		dudy = (a11 * dpdy[dim0] - a01 * dpdy[dim1]) * invDet;
+		dvdy = (a00 * dpdy[dim1] - a10 * dpdy[dim0]) * invDet;
+		if (!std::isfinite(dudx) || !std::isfinite(dvdx) || !std::isfinite(dudy) || !std::isfinite(dvdy))
+			dudx = dvdx = dudy = dvdy = 0.0f;
+	}
+
+	// Compute the differentials for the ray and create the BSDF of the point in the arena
+	void SurfaceInteraction::ComputeScatteringFunctions(const RayDifferential& ray, MemoryArena& arena, float albedo) {
+		ComputeDifferentials(ray);
+		Normal3f ns = _n.Normalized();
+		if (Dot(ns, _wo) < 0.0f)
+			ns *= -1;
+		bsdf = arena.Create<BSDF>(ns, albedo);
+	}
+
+	// Spawn the perfect mirror reflection of the ray about the shading normal
+	// The auxiliary rays are reflected about the normal at their own hit points on the tangent plane (Igehy)
+	RayDifferential SurfaceInteraction::SpawnSpecularReflection(const RayDifferential& ray, const Normal3f& ns) const {
+		const Vector3f& wo = _wo;
+		Vector3f wi = -wo + Vector3f(ns) * (2 * Dot(wo, ns));
+		RayDifferential reflected = SpawnRay(wi);
+		if (!ray.hasDifferentials)
+			return reflected;
+
+		reflected.hasDifferentials = true;
+		reflected.rxOrigin = _p + dpdx;
+		reflected.ryOrigin = _p + dpdy;
+
+		// Change of the normal and of the incoming direction across the footprint
+		Normal3f dndx = dndu * dudx + dndv * dvdx;
+		Normal3f dndy = dndu * dudy + dndv * dvdy;
+		Vector3f dwodx = -ray.rxDirection - wo, dwody = -ray.ryDirection - wo;
+		float dDNdx = Dot(dwodx, ns) + Dot(wo, dndx);
+		float dDNdy = Dot(dwody, ns) + Dot(wo, dndy);
+		reflected.rxDirection = wi - dwodx + Vector3f(dndx * Dot(wo, ns) + ns * dDNdx) * 2;
+		reflected.ryDirection = wi - dwody + Vector3f(dndy * Dot(wo, ns) + ns * dDNdy) * 2;
+		return reflected;
+	}
 }
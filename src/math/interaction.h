@@ -6,19 +6,25 @@
 #include "point2.h"
 #include "normal3.h"
 #include "vector3.h"
+#include "ray.h"
 #include "shape.h"
 #include "primitive.h"
 
 namespace apollo {
 
+class BSDF;
+class MemoryArena;
+
 class Interaction {
 	public:
 		Interaction() {}
-		Interaction(const Point3f &p, const Normal3f &n, const Vector3f &wo, float time);
+		Interaction(const Point3f &p, const Vector3f &pError, const Normal3f &n, const Vector3f &wo, float time);
 		
 		// Accessor methods
 		const Point3f& p() const;
 		Point3f& p();
+		const Vector3f& pError() const;
+		Vector3f& pError();
 		const float& time() const;
 		float& time();
 		const Vector3f& wo() const;
@@ -26,9 +32,17 @@ class Interaction {
 		const Normal3f& n() const;
 		Normal3f& n();
 
+		// Spawn a ray leaving the surface in direction d
+		Ray SpawnRay(const Vector3f& d) const;
+
+		// Spawn a ray towards p2 that stops just short of it (t in [0, 1 - ShadowEpsilon])
+		Ray SpawnRayTo(const Point3f& p2) const;
+
 	protected:
 		// Intersection point
 		Point3f _p;
+		// Conservative bound on the absolute rounding error of each coordinate of _p
+		Vector3f _pError;
 		// Time of intersection
 		float _time;
 		// Negative ray direction
@@ -41,13 +55,23 @@ class Interaction {
 class SurfaceInteraction : public Interaction {
 	public:
 		SurfaceInteraction() {}
-		SurfaceInteraction(const Point3f& p, const Normal3f& n, const Point2f& uv, const Vector3f& wo,
-				   float time, const Shape *shape);
+		SurfaceInteraction(const Point3f& p, const Vector3f& pError, const Normal3f& n, const Point2f& uv, const Vector3f& dpdu,
+				   const Vector3f& dpdv, const Normal3f& dndu, const Normal3f& dndv, const Vector3f& wo, float time, const Shape *shape);
 
 		// Accessor methods
 		const Point2f& uv() const;
 		Point2f& uv();
 
+		// Estimate the screen space derivatives of p and (u, v) from the footprint of the ray (zero without differentials)
+		void ComputeDifferentials(const RayDifferential& ray);
+
+		// Compute the differentials for the ray and create the BSDF of the point in the arena
+		// The shading normal faces the side the ray arrived from
+		void ComputeScatteringFunctions(const RayDifferential& ray, MemoryArena& arena, float albedo);
+
+		// Spawn the perfect mirror reflection of the ray about the shading normal ns, carrying its differentials along
+		RayDifferential SpawnSpecularReflection(const RayDifferential& ray, const Normal3f& ns) const;
+
 	private:
 		// (u,v) coords from the parameterization of the surface
 		Point2f _uv;
@@ -56,6 +80,16 @@ class SurfaceInteraction : public Interaction {
 		const Shape *shape = nullptr;
 		// Hit primitive
 		const Primitive *primitive = nullptr;
+		// Scattering at the point; owned by the arena passed to ComputeScatteringFunctions
+		BSDF *bsdf = nullptr;
+
+		// Partial derivatives of the position and the normalized normal with respect to (u, v)
+		Vector3f dpdu, dpdv;
+		Normal3f dndu, dndv;
+
+		// Screen space derivatives filled in by ComputeDifferentials
+		Vector3f dpdx, dpdy;
+		float dudx = 0, dvdx = 0, dudy = 0, dvdy = 0;
 };
 
 }
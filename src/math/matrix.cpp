@@ -1,6 +1,10 @@
 #include "apollo.h"
 #include "matrix.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace apollo {
 
 // 4x4 Matrix Method Definitions
@@ -15,7 +19,7 @@ Matrix::Matrix() {
 
 // Constructor from an array of 16 floats
 Matrix::Matrix(const float mat[16]) {
-	for (int i = 0; i < 15; i++)
+	for (int i = 0; i < 16; i++)
 		m[i] = mat[i];
 }
 
@@ -31,6 +35,25 @@ Matrix::Matrix(float t00, float t01, float t02, float t03,
 }
 
 // Matrix multiplication
+#if defined(__SSE2__)
+// Each result row is a linear combination of the rows of mat
+Matrix Matrix::operator*(const Matrix& mat) const {
+	const __m128 row0 = _mm_loadu_ps(mat.m);
+	const __m128 row1 = _mm_loadu_ps(mat.m + 4);
+	const __m128 row2 = _mm_loadu_ps(mat.m + 8);
+	const __m128 row3 = _mm_loadu_ps(mat.m + 12);
+
+	Matrix result;
+	for (int i = 0; i < 4; i++) {
+		__m128 r = _mm_mul_ps(_mm_set1_ps(m[i*4]), row0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i*4+1]), row1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i*4+2]), row2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i*4+3]), row3));
+		_mm_storeu_ps(result.m + i*4, r);
+	}
+	return result;
+}
+#else
 Matrix Matrix::operator*(const Matrix& mat) const {
 	float result[16];
 	for (int i = 0; i < 4; i++) {
@@ -44,6 +67,7 @@ Matrix Matrix::operator*(const Matrix& mat) const {
 	}
 	return Matrix(result);
 }
+#endif
 
 // Matrix determinant
 float Matrix::Determinant() const {
@@ -71,6 +95,87 @@ Matrix Matrix::Transpose() const {
 }
 
 // Matrix inverse
+#if defined(__SSE2__)
+// Shuffle helpers; lanes are selected from a (first two) and b (last two)
+#define APOLLO_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, (x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define APOLLO_SWIZZLE(a, x, y, z, w) APOLLO_SHUFFLE(a, a, x, y, z, w)
+
+// 2x2 row-major matrices packed in one register: A * B
+static inline __m128 Mat2Mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, APOLLO_SWIZZLE(b, 0, 3, 0, 3)),
+			  _mm_mul_ps(APOLLO_SWIZZLE(a, 1, 0, 3, 2), APOLLO_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adj(A) * B
+static inline __m128 Mat2AdjMul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(APOLLO_SWIZZLE(a, 3, 3, 0, 0), b),
+			  _mm_mul_ps(APOLLO_SWIZZLE(a, 1, 1, 2, 2), APOLLO_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// A * adj(B)
+static inline __m128 Mat2MulAdj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, APOLLO_SWIZZLE(b, 3, 0, 3, 0)),
+			  _mm_mul_ps(APOLLO_SWIZZLE(a, 1, 0, 3, 2), APOLLO_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// Block-wise inverse: the matrix is split into 2x2 blocks | A B |
+//                                                        | C D |
+bool Matrix::Inverse(Matrix& out) const {
+	const __m128 row0 = _mm_loadu_ps(m);
+	const __m128 row1 = _mm_loadu_ps(m + 4);
+	const __m128 row2 = _mm_loadu_ps(m + 8);
+	const __m128 row3 = _mm_loadu_ps(m + 12);
+
+	const __m128 A = _mm_movelh_ps(row0, row1);
+	const __m128 B = _mm_movehl_ps(row1, row0);
+	const __m128 C = _mm_movelh_ps(row2, row3);
+	const __m128 D = _mm_movehl_ps(row3, row2);
+
+	// Determinants of the blocks as (|A|, |B|, |C|, |D|)
+	const __m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(APOLLO_SHUFFLE(row0, row2, 0, 2, 0, 2), APOLLO_SHUFFLE(row1, row3, 1, 3, 1, 3)),
+		_mm_mul_ps(APOLLO_SHUFFLE(row0, row2, 1, 3, 1, 3), APOLLO_SHUFFLE(row1, row3, 0, 2, 0, 2)));
+	const __m128 detA = APOLLO_SWIZZLE(detSub, 0, 0, 0, 0);
+	const __m128 detB = APOLLO_SWIZZLE(detSub, 1, 1, 1, 1);
+	const __m128 detC = APOLLO_SWIZZLE(detSub, 2, 2, 2, 2);
+	const __m128 detD = APOLLO_SWIZZLE(detSub, 3, 3, 3, 3);
+
+	const __m128 DC = Mat2AdjMul(D, C);
+	const __m128 AB = Mat2AdjMul(A, B);
+
+	// Adjugates of the blocks of the inverse (before dividing by |M|)
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, DC));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, AB));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, AB));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, DC));
+
+	// |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 tr = _mm_mul_ps(AB, APOLLO_SWIZZLE(DC, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, APOLLO_SWIZZLE(tr, 1, 0, 3, 2));
+	tr = _mm_add_ps(tr, APOLLO_SWIZZLE(tr, 2, 3, 0, 1));
+	const __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	if (_mm_cvtss_f32(detM) == 0.0f)
+		return false;
+
+	const __m128 invDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+	X = _mm_mul_ps(X, invDetM);
+	Y = _mm_mul_ps(Y, invDetM);
+	Z = _mm_mul_ps(Z, invDetM);
+	W = _mm_mul_ps(W, invDetM);
+
+	// Take the adjugates of the blocks while storing them back in row order
+	_mm_storeu_ps(out.m,      APOLLO_SHUFFLE(X, Y, 3, 1, 3, 1));
+	_mm_storeu_ps(out.m + 4,  APOLLO_SHUFFLE(X, Y, 2, 0, 2, 0));
+	_mm_storeu_ps(out.m + 8,  APOLLO_SHUFFLE(Z, W, 3, 1, 3, 1));
+	_mm_storeu_ps(out.m + 12, APOLLO_SHUFFLE(Z, W, 2, 0, 2, 0));
+
+	return true;
+}
+
+#undef APOLLO_SWIZZLE
+#undef APOLLO_SHUFFLE
+#else
 bool Matrix::Inverse(Matrix& out) const {
     	float d = Determinant();
     	if (d == 0.0f)
@@ -99,6 +204,7 @@ bool Matrix::Inverse(Matrix& out) const {
 								        
 	return true;
 }
+#endif
 
 // Print Matrix
 std::ostream& operator<<(std::ostream& out, const Matrix& mat) {
@@ -42,6 +42,18 @@ class Matrix {
 		float m[16];
 };
 
+// Compare matrices element-wise
+inline bool operator==(const Matrix& m1, const Matrix& m2) {
+	for (int i = 0; i < 16; i++)
+		if (m1.m[i] != m2.m[i])
+			return false;
+	return true;
+}
+
+inline bool operator!=(const Matrix& m1, const Matrix& m2) {
+	return !(m1 == m2);
+}
+
 // Print Matrix
 std::ostream& operator<<(std::ostream& out, const Matrix& mat); 
 
@@ -0,0 +1,66 @@
+#include "quaternion.h"
+
+namespace apollo {
+
+// Quaternion Method Definitions
+// =============================
+
+// Rotation of the upper 3x3 of a matrix, which must be orthonormal
+Quaternion::Quaternion(const Matrix& mat) {
+	const float* m = mat.m;
+	const float trace = m[0] + m[5] + m[10];
+	if (trace > 0.0f) {
+		// w is the largest component, so dividing by it is stable
+		float s = std::sqrt(trace + 1.0f);
+		w = s / 2;
+		s = 0.5f / s;
+		v = Vector3f(m[9] - m[6], m[2] - m[8], m[4] - m[1]) * s;
+	} else {
+		// Compute the component with the largest diagonal element first
+		int i = 0;
+		if (m[5] > m[0])
+			i = 1;
+		if (m[10] > m[4 * i + i])
+			i = 2;
+		const int j = (i + 1) % 3, k = (j + 1) % 3;
+
+		float s = std::sqrt(m[4 * i + i] - m[4 * j + j] - m[4 * k + k] + 1.0f);
+		v[i] = s / 2;
+		s = 0.5f / s;
+		w = (m[4 * k + j] - m[4 * j + k]) * s;
+		v[j] = (m[4 * j + i] + m[4 * i + j]) * s;
+		v[k] = (m[4 * k + i] + m[4 * i + k]) * s;
+	}
+}
+
+// Rotation matrix of a unit quaternion
+Matrix Quaternion::ToMatrix() const {
+	const float xx = v.x * v.x, yy = v.y * v.y, zz = v.z * v.z;
+	const float xy = v.x * v.y, xz = v.x * v.z, yz = v.y * v.z;
+	const float wx = v.x * w, wy = v.y * w, wz = v.z * w;
+
+	return Matrix(1 - 2 * (yy + zz), 2 * (xy - wz),     2 * (xz + wy),     0,
+		      2 * (xy + wz),     1 - 2 * (xx + zz), 2 * (yz - wx),     0,
+		      2 * (xz - wy),     2 * (yz + wx),     1 - 2 * (xx + yy), 0,
+		      0,                 0,                 0,                 1);
+}
+
+// Spherical linear interpolation between two unit quaternions along the shorter arc
+Quaternion Slerp(float t, const Quaternion& q1, const Quaternion& q2) {
+	// q and -q are the same rotation; flip q2 into the hemisphere of q1
+	float cosTheta = Dot(q1, q2);
+	const Quaternion q2Near = cosTheta < 0.0f ? -q2 : q2;
+	cosTheta = std::abs(cosTheta);
+
+	// Nearly parallel rotations: linear interpolation is accurate and avoids dividing by sin(theta) ~ 0
+	if (cosTheta > 0.9995f)
+		return Normalize(q1 * (1 - t) + q2Near * t);
+
+	// Rotate q1 by t * theta towards q2 within their common plane
+	const float theta = std::acos(std::min(cosTheta, 1.0f));
+	const float thetaT = theta * t;
+	const Quaternion qPerp = Normalize(q2Near - q1 * cosTheta);
+	return q1 * std::cos(thetaT) + qPerp * std::sin(thetaT);
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef APOLLO_MATH_QUATERNION_H
+#define APOLLO_MATH_QUATERNION_H
+
+#include "apollo.h"
+#include "vector3.h"
+#include "matrix.h"
+
+namespace apollo {
+
+// Unit quaternions represent rotations; animated transforms interpolate their rotation component with them
+class Quaternion {
+	public:
+		// Identity rotation
+		Quaternion() : v(0.0f), w(1.0f) {}
+		Quaternion(const Vector3f& v, float w) : v(v), w(w) {}
+
+		// Rotation of the upper 3x3 of a matrix, which must be orthonormal
+		explicit Quaternion(const Matrix& m);
+
+		// Rotation matrix of a unit quaternion
+		Matrix ToMatrix() const;
+
+		// Addition, subtraction and scalar multiplication
+		Quaternion operator+(const Quaternion& q) const { return Quaternion(v + q.v, w + q.w); }
+		Quaternion operator-(const Quaternion& q) const { return Quaternion(v - q.v, w - q.w); }
+		Quaternion operator-() const { return Quaternion(-v, -w); }
+		Quaternion operator*(float s) const { return Quaternion(v * s, w * s); }
+		Quaternion operator/(float s) const { return Quaternion(v / s, w / s); }
+
+		// Quaternion public data
+		Vector3f v;
+		float w;
+};
+
+// Inner product of two quaternions
+inline float Dot(const Quaternion& q1, const Quaternion& q2) {
+	return Dot(q1.v, q2.v) + q1.w * q2.w;
+}
+
+// Scale a quaternion to unit length
+inline Quaternion Normalize(const Quaternion& q) {
+	return q / std::sqrt(Dot(q, q));
+}
+
+// Spherical linear interpolation between two unit quaternions along the shorter arc
+Quaternion Slerp(float t, const Quaternion& q1, const Quaternion& q2);
+
+}
+
+#endif
@@ -3,15 +3,52 @@
 
 namespace apollo {
 
-Ray::Ray() : tMax(Infinity), time(0.f) {}
+Ray::Ray() : tMax(Infinity), time(0.f), kx(0), ky(1), kz(2), Sx(0.f), Sy(0.f), Sz(0.f) {}
 
-Ray::Ray(const Point3f& o, const Vector3f& d, float tMax, float time) : o(o), d(d), tMax(tMax), time(time) {}
+Ray::Ray(const Point3f& o, const Vector3f& d, float tMax, float time) : o(o), d(d), tMax(tMax), time(time) {
+	// Permute the largest direction component into z (cyclically, which keeps handedness)
+	const Vector3f absD = d.Abs();
+	kz = absD.x > absD.y ? (absD.x > absD.z ? 0 : 2) : (absD.y > absD.z ? 1 : 2);
+	kx = kz == 2 ? 0 : kz + 1;
+	ky = kx == 2 ? 0 : kx + 1;
+
+	Sz = 1.0f / d[kz];
+	Sx = -d[kx] * Sz;
+	Sy = -d[ky] * Sz;
+}
 
 // Find point at t
 Point3f Ray::operator()(float t) const {
 	return o + t*d;
 }
 
+// Move a ray origin along the surface normal by the rounding error bound of the point
+Point3f OffsetRayOrigin(const Point3f& p, const Vector3f& pError, const Normal3f& n, const Vector3f& w) {
+	const Vector3f nUnit = Vector3f(n).Normalized();
+	Vector3f offset = nUnit * Dot(nUnit.Abs(), pError);
+	if (Dot(w, n) < 0)
+		offset = -offset;
+
+	Point3f po = p + offset;
+
+	// Round away from p so the offset is not lost to rounding
+	for (int i = 0; i < 3; i++) {
+		if (offset[i] > 0)
+			po[i] = NextFloatUp(po[i]);
+		else if (offset[i] < 0)
+			po[i] = NextFloatDown(po[i]);
+	}
+	return po;
+}
+
+// Scale the offsets of the auxiliary rays to the sample spacing
+void RayDifferential::ScaleDifferentials(float s) {
+	rxOrigin = o + (rxOrigin - o) * s;
+	ryOrigin = o + (ryOrigin - o) * s;
+	rxDirection = d + (rxDirection - d) * s;
+	ryDirection = d + (ryDirection - d) * s;
+}
+
 // Print ray
 std::ostream& operator<<(std::ostream& out, const Ray& r) {
 	return out << "[o=" << r.o << ", d=" << r.d << ", tMax=" << r.tMax << ", time=" << r.time << "]";
@@ -20,11 +20,40 @@ class Ray {
 		Vector3f d;
 		mutable float tMax;
 		float time;
+
+		// Watertight triangle test constants, derived from d on construction: the axis along which d
+		// is largest becomes z (kz), and the shear (Sx, Sy, Sz) maps d to (0, 0, 1)
+		int kx, ky, kz;
+		float Sx, Sy, Sz;
+};
+
+// Ray with two auxiliary rays, offset by one pixel in x and y on the film, that describe its footprint
+// Texture filtering uses the footprint to choose a filter width at hit points
+class RayDifferential : public Ray {
+	public:
+		RayDifferential() : hasDifferentials(false) {}
+		RayDifferential(const Point3f& o, const Vector3f& d, float tMax = Infinity, float time = 0.f)
+			: Ray(o, d, tMax, time), hasDifferentials(false) {}
+
+		// Ray without differentials
+		RayDifferential(const Ray& ray) : Ray(ray), hasDifferentials(false) {}
+
+		// Scale the offsets to the sample spacing, e.g. 1 / sqrt(samples per pixel)
+		void ScaleDifferentials(float s);
+
+		// RayDifferential public data
+		bool hasDifferentials;
+		Point3f rxOrigin, ryOrigin;
+		Vector3f rxDirection, ryDirection;
 };
 
 // Print ray
 std::ostream& operator<<(std::ostream& out, const Ray& r);
 
+// Move a ray origin p (with absolute rounding error pError) along the surface normal n, just far
+// enough to the side w leaves through that a ray from it cannot re-hit the surface at p
+Point3f OffsetRayOrigin(const Point3f& p, const Vector3f& pError, const Normal3f& n, const Vector3f& w);
+
 }
 
 #endif
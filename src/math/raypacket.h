@@ -0,0 +1,84 @@
+#ifndef APOLLO_MATH_RAYPACKET_H
+#define APOLLO_MATH_RAYPACKET_H
+
+#include "apollo.h"
+#include "ray.h"
+#include "bounds3.h"
+
+namespace apollo {
+
+// Maximum number of rays in a packet (an 8x8 pixel block)
+static constexpr int MaxPacketSize = 64;
+
+// Four planes through a common apex bounding a bundle of rays
+struct Frustum {
+	// Check if a box lies completely outside of the frustum
+	bool Excludes(const Bounds3f& b) const {
+		for (int i = 0; i < 4; i++) {
+			// Box corner farthest along the inward facing plane normal
+			const Vector3f& n = normals[i];
+			Point3f p(n.x >= 0 ? b.pMax.x : b.pMin.x,
+				  n.y >= 0 ? b.pMax.y : b.pMin.y,
+				  n.z >= 0 ? b.pMax.z : b.pMin.z);
+			if (Dot(p - apex, n) < 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Common origin of the rays
+	Point3f apex;
+	// Inward facing normals of the side planes
+	Vector3f normals[4];
+};
+
+// Bundle of coherent rays (usually primary rays of neighboring pixels) traced together
+class RayPacket {
+	public:
+		RayPacket() : size(0), hasFrustum(false) {}
+
+		// Append a ray to the packet
+		void Add(const Ray& r) {
+			rays[size] = r;
+			invDir[size] = Vector3f(1.0f / r.d.x, 1.0f / r.d.y, 1.0f / r.d.z);
+			size++;
+		}
+
+		// Remove all rays
+		void Clear() {
+			size = 0;
+			hasFrustum = false;
+		}
+
+		// Check if all ray directions lie in the same octant, which ordered packet traversal relies on
+		bool SameOctant() const {
+			for (int i = 1; i < size; i++)
+				if ((rays[i].d.x < 0) != (rays[0].d.x < 0) || (rays[i].d.y < 0) != (rays[0].d.y < 0) ||
+				    (rays[i].d.z < 0) != (rays[0].d.z < 0))
+					return false;
+			return true;
+		}
+
+		// Bound all rays by the frustum spanned by four corner directions from a common apex (given in cyclic order)
+		void SetFrustum(const Point3f& apex, const Vector3f corners[4]) {
+			Vector3f center = corners[0] + corners[1] + corners[2] + corners[3];
+			frustum.apex = apex;
+			for (int i = 0; i < 4; i++) {
+				Vector3f n = Cross(corners[i], corners[(i + 1) % 4]);
+				frustum.normals[i] = Dot(n, center) < 0 ? -n : n;
+			}
+			hasFrustum = true;
+		}
+
+		// RayPacket public data
+		Ray rays[MaxPacketSize];
+		// Reciprocal ray directions used for box tests
+		Vector3f invDir[MaxPacketSize];
+		int size;
+		bool hasFrustum;
+		Frustum frustum;
+};
+
+}
+
+#endif
@@ -1,14 +1,25 @@
 #include "apollo.h"
 #include "transform.h"
+#include "parallel.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 namespace apollo {
 
+// Check if the projective row of a matrix is trivial
+static bool IsAffineMatrix(const Matrix& m) {
+	return m.m[12] == 0.0f && m.m[13] == 0.0f && m.m[14] == 0.0f && m.m[15] == 1.0f;
+}
+
 Transform::Transform(const Matrix& m) {
 	this->m = m;
 	m.Inverse(mInv);
+	affine = IsAffineMatrix(m);
 }
 
-Transform::Transform(const Matrix& m, const Matrix& mInv) : m(m), mInv(mInv) {}
+Transform::Transform(const Matrix& m, const Matrix& mInv) : m(m), mInv(mInv), affine(IsAffineMatrix(m)) {}
 
 Matrix Transform::GetMatrix() const {
 	return m;
@@ -119,17 +130,187 @@ Transform LookAt(const Point3f& pos, const Point3f& look, const Vector3f& up) {
 
 }
 
+// Bounding box of a transformed box
+Bounds3f TransformBounds(const Transform& t, const Bounds3f& b) {
+	// Bound the transformed corners
+	Bounds3f result;
+	for (int i = 0; i < 8; i++)
+		result.Union(t(Point3f(b[i & 1].x, b[(i >> 1) & 1].y, b[(i >> 2) & 1].z)));
+	return result;
+}
+
+// Animated Transformations
+// ========================
+
+AnimatedTransform::AnimatedTransform(const Transform& startTransform, float startTime, const Transform& endTransform, float endTime)
+	: startTime(startTime), endTime(endTime), startTransform(startTransform), endTransform(endTransform),
+	  animated(startTransform != endTransform && endTime > startTime) {
+	Decompose(startTransform.GetMatrix(), &T[0], &R[0], &S[0]);
+	Decompose(endTransform.GetMatrix(), &T[1], &R[1], &S[1]);
+}
+
+// Split an affine matrix into translation, rotation and the remaining scale such that m = T * R * S
+void AnimatedTransform::Decompose(const Matrix& m, Vector3f* T, Quaternion* R, Matrix* S) {
+	*T = Vector3f(m.m[3], m.m[7], m.m[11]);
+
+	// Upper 3x3 without the translation
+	Matrix M = m;
+	M.m[3] = M.m[7] = M.m[11] = 0.0f;
+	M.m[12] = M.m[13] = M.m[14] = 0.0f;
+	M.m[15] = 1.0f;
+
+	// Polar decomposition: averaging a matrix with its inverse transpose converges to the closest rotation
+	Matrix rotation = M;
+	for (int count = 0; count < 100; count++) {
+		Matrix inverseTranspose;
+		rotation.Transpose().Inverse(inverseTranspose);
+
+		float norm = 0.0f;
+		Matrix next;
+		for (int i = 0; i < 3; i++) {
+			float rowSum = 0.0f;
+			for (int j = 0; j < 3; j++) {
+				next.m[4*i + j] = 0.5f * (rotation.m[4*i + j] + inverseTranspose.m[4*i + j]);
+				rowSum += std::abs(next.m[4*i + j] - rotation.m[4*i + j]);
+			}
+			norm = std::max(norm, rowSum);
+		}
+		rotation = next;
+		if (norm < 0.0001f)
+			break;
+	}
+	*R = Quaternion(rotation);
+
+	// Whatever the rotation does not explain is scale (and shear)
+	Matrix rotationInverse;
+	rotation.Inverse(rotationInverse);
+	*S = rotationInverse * M;
+}
+
+// Transformation at the given time; times outside the keyframe interval clamp to the nearest keyframe
+Transform AnimatedTransform::Interpolate(float time) const {
+	if (!animated || time <= startTime)
+		return startTransform;
+	if (time >= endTime)
+		return endTransform;
+
+	const float dt = (time - startTime) / (endTime - startTime);
+	const Vector3f trans = T[0] * (1 - dt) + T[1] * dt;
+	const Quaternion rotate = Slerp(dt, R[0], R[1]);
+	Matrix scale;
+	for (int i = 0; i < 12; i++)
+		scale.m[i] = Lerp(dt, S[0].m[i], S[1].m[i]);
+
+	// T * R * S; the translation only fills in the last column
+	Matrix m = rotate.ToMatrix() * scale;
+	m.m[3] = trans.x;
+	m.m[7] = trans.y;
+	m.m[11] = trans.z;
+	return Transform(m);
+}
+
+// Box swept by transforming b over the keyframe interval
+Bounds3f AnimatedTransform::MotionBounds(const Bounds3f& b) const {
+	Bounds3f b0, b1;
+	LinearMotionBounds(b, startTime, endTime, &b0, &b1);
+	return b0.Union(b1);
+}
+
+// The transformed box is bounded at a set of sample times, which also include the keyframe times where the motion starts
+// and stops. Between two samples, every corner deviates from the straight line joining its sampled positions by at most
+// h^2 / 8 times its largest acceleration, where h is the sample spacing. With the rotation turning at a constant angular
+// speed w and the scaled corner y changing linearly, the acceleration is bounded by w^2 |y| + 2 w |y'|. Boxes widened by
+// that much at every sample are then shifted until their linear interpolation contains all of them
+void AnimatedTransform::LinearMotionBounds(const Bounds3f& b, float time0, float time1, Bounds3f* b0, Bounds3f* b1) const {
+	if (!animated || time1 <= time0) {
+		*b0 = *b1 = TransformBounds(Interpolate(time0), b);
+		return;
+	}
+
+	// Sample times over [time0, time1]
+	constexpr int nSamples = 32;
+	std::vector<float> times;
+	times.reserve(nSamples + 3);
+	for (int i = 0; i <= nSamples; i++)
+		times.push_back(Lerp((float)i / nSamples, time0, time1));
+	for (float t : { startTime, endTime })
+		if (t > time0 && t < time1)
+			times.push_back(t);
+	std::sort(times.begin(), times.end());
+
+	std::vector<Bounds3f> boxes(times.size());
+	float maxCoordinate = 0.0f;
+	for (size_t i = 0; i < times.size(); i++) {
+		boxes[i] = TransformBounds(Interpolate(times[i]), b);
+		for (int j = 0; j < 2; j++)
+			maxCoordinate = std::max(maxCoordinate, std::max(std::abs(boxes[i][j].x), std::max(std::abs(boxes[i][j].y), std::abs(boxes[i][j].z))));
+	}
+
+	// Widest sample spacing in which the motion is not clamped, relative to the keyframe interval
+	float h = 0.0f;
+	for (size_t i = 0; i + 1 < times.size(); i++)
+		if (times[i] >= startTime && times[i + 1] <= endTime)
+			h = std::max(h, times[i + 1] - times[i]);
+	h /= endTime - startTime;
+
+	// Largest acceleration of a corner; the rotation angle is twice the angle between the quaternions
+	const float w = 2 * std::acos(std::min(std::abs(Dot(R[0], R[1])), 1.0f));
+	float maxAcceleration = 0.0f;
+	auto scale = [](const Matrix& m, const Point3f& p) {
+		return Vector3f(m.m[0]*p.x + m.m[1]*p.y + m.m[2]*p.z, m.m[4]*p.x + m.m[5]*p.y + m.m[6]*p.z, m.m[8]*p.x + m.m[9]*p.y + m.m[10]*p.z);
+	};
+	for (int i = 0; i < 8; i++) {
+		const Point3f corner(b[i & 1].x, b[(i >> 1) & 1].y, b[(i >> 2) & 1].z);
+		const Vector3f y0 = scale(S[0], corner), y1 = scale(S[1], corner);
+		const float y = std::max(y0.Length(), y1.Length());
+		maxAcceleration = std::max(maxAcceleration, w * w * y + 2 * w * (y1 - y0).Length());
+	}
+
+	// The interpolated bounds are also off by rounding errors
+	const float pad = h * h / 8 * maxAcceleration + Gamma(3) * maxCoordinate;
+
+	// Shift both ends of every face by the largest amount a padded sample pokes out of it
+	*b0 = boxes.front();
+	*b1 = boxes.back();
+	for (size_t i = 0; i < times.size(); i++) {
+		const float u = (times[i] - time0) / (time1 - time0);
+		for (int axis = 0; axis < 3; axis++) {
+			const float lo = (*b0).pMin[axis] + u * ((*b1).pMin[axis] - (*b0).pMin[axis]);
+			const float hi = (*b0).pMax[axis] + u * ((*b1).pMax[axis] - (*b0).pMax[axis]);
+			const float dLo = std::min(0.0f, boxes[i].pMin[axis] - pad - lo);
+			const float dHi = std::max(0.0f, boxes[i].pMax[axis] + pad - hi);
+			(*b0).pMin[axis] += dLo;
+			(*b1).pMin[axis] += dLo;
+			(*b0).pMax[axis] += dHi;
+			(*b1).pMax[axis] += dHi;
+		}
+	}
+}
+
 // Apply transformation to geometries
 // ==================================
 SurfaceInteraction Transform::operator()(const SurfaceInteraction& s) const {
 	const Transform &t = *this;	
 	
 	SurfaceInteraction result;
-	result.p() = t(s.p());
+	result.p() = t(s.p(), s.pError(), &result.pError());
 	result.time() = s.time();
 	result.n() = t(s.n()).Normalize();
 	result.wo() = t(s.wo());
 	result.uv() = s.uv();
+	result.shape = s.shape;
+	result.primitive = s.primitive;
+	result.bsdf = s.bsdf;
+	result.dpdu = t(s.dpdu);
+	result.dpdv = t(s.dpdv);
+	result.dndu = t(s.dndu);
+	result.dndv = t(s.dndv);
+	result.dpdx = t(s.dpdx);
+	result.dpdy = t(s.dpdy);
+	result.dudx = s.dudx;
+	result.dvdx = s.dvdx;
+	result.dudy = s.dudy;
+	result.dvdy = s.dvdy;
 
 	return result;
 }
@@ -139,4 +320,104 @@ Transform Transform::operator*(const Transform& t) const {
 	return Transform(m * t.m, t.mInv * mInv);
 }
 
+// Apply transformation to arrays of geometries
+// =============================================
+static_assert(sizeof(Point3f) == 3 * sizeof(float) && sizeof(Vector3f) == 3 * sizeof(float) &&
+	      sizeof(Normal3f) == 3 * sizeof(float), "batch transforms expect tightly packed xyz");
+
+// Arrays at least this long are split across threads
+static const size_t ParallelTransformChunk = 1 << 15;
+
+// out[i] = r * (in[i], 1) for n packed xyz triples, where r holds three matrix rows
+static void TransformXYZ(const float r[12], const float* in, float* out, size_t n) {
+	size_t i = 0;
+#if defined(__SSE__)
+	const __m128 r0 = _mm_set1_ps(r[0]), r1 = _mm_set1_ps(r[1]), r2  = _mm_set1_ps(r[2]),  r3  = _mm_set1_ps(r[3]);
+	const __m128 r4 = _mm_set1_ps(r[4]), r5 = _mm_set1_ps(r[5]), r6  = _mm_set1_ps(r[6]),  r7  = _mm_set1_ps(r[7]);
+	const __m128 r8 = _mm_set1_ps(r[8]), r9 = _mm_set1_ps(r[9]), r10 = _mm_set1_ps(r[10]), r11 = _mm_set1_ps(r[11]);
+
+	// Four elements at a time: deinterleave to x, y and z lanes, transform, interleave back
+	for (; i + 4 <= n; i += 4) {
+		const float* src = in + 3 * i;
+		const __m128 a0 = _mm_loadu_ps(src);		// x0 y0 z0 x1
+		const __m128 a1 = _mm_loadu_ps(src + 4);	// y1 z1 x2 y2
+		const __m128 a2 = _mm_loadu_ps(src + 8);	// z2 x3 y3 z3
+
+		const __m128 xyzx = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(1, 0, 3, 2));	// x2 y2 z2 x3
+		const __m128 yz01 = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 0, 2, 1));
+		const __m128 yz23 = _mm_shuffle_ps(xyzx, a2, _MM_SHUFFLE(3, 2, 2, 1));
+		const __m128 x = _mm_shuffle_ps(a0, xyzx, _MM_SHUFFLE(3, 0, 3, 0));
+		const __m128 y = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 z = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, x), _mm_mul_ps(r1, y)), _mm_add_ps(_mm_mul_ps(r2, z),  r3));
+		const __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r4, x), _mm_mul_ps(r5, y)), _mm_add_ps(_mm_mul_ps(r6, z),  r7));
+		const __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r8, x), _mm_mul_ps(r9, y)), _mm_add_ps(_mm_mul_ps(r10, z), r11));
+
+		const __m128 xy01 = _mm_unpacklo_ps(tx, ty);	// x0 y0 x1 y1
+		const __m128 xy23 = _mm_unpackhi_ps(tx, ty);	// x2 y2 x3 y3
+		const __m128 zx01 = _mm_shuffle_ps(tz, xy01, _MM_SHUFFLE(2, 2, 0, 0));
+		const __m128 yz1  = _mm_shuffle_ps(xy01, tz, _MM_SHUFFLE(1, 1, 3, 3));
+		const __m128 zx23 = _mm_shuffle_ps(tz, xy23, _MM_SHUFFLE(2, 2, 2, 2));
+		const __m128 yz3  = _mm_shuffle_ps(xy23, tz, _MM_SHUFFLE(3, 3, 3, 3));
+
+		float* dst = out + 3 * i;
+		_mm_storeu_ps(dst,     _mm_shuffle_ps(xy01, zx01, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz1, xy23,  _MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx23, yz3,  _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+#endif
+	// Remaining elements
+	for (; i < n; i++) {
+		const float x = in[3*i], y = in[3*i+1], z = in[3*i+2];
+		out[3*i]   = r[0]*x + r[1]*y + r[2]*z  + r[3];
+		out[3*i+1] = r[4]*x + r[5]*y + r[6]*z  + r[7];
+		out[3*i+2] = r[8]*x + r[9]*y + r[10]*z + r[11];
+	}
+}
+
+// Run kernel(begin, end) over [0, n), in parallel chunks for large arrays
+template <typename Kernel> static void ForEachChunk(size_t n, const Kernel& kernel) {
+	if (n < 2 * ParallelTransformChunk) {
+		kernel(0, n);
+		return;
+	}
+
+	const int64_t nChunks = (n + ParallelTransformChunk - 1) / ParallelTransformChunk;
+	ParallelFor([&](int64_t chunk) {
+		const size_t begin = chunk * ParallelTransformChunk;
+		kernel(begin, std::min(n, begin + ParallelTransformChunk));
+	}, nChunks);
+}
+
+void Transform::operator()(const Point3f* p, size_t n, Point3f* out) const {
+	const float* r = m.m;
+	ForEachChunk(n, [&](size_t begin, size_t end) {
+		if (affine)
+			TransformXYZ(r, &p[begin].x, &out[begin].x, end - begin);
+		else
+			for (size_t i = begin; i < end; i++)
+				out[i] = (*this)(p[i]);
+	});
+}
+
+void Transform::operator()(const Vector3f* v, size_t n, Vector3f* out) const {
+	const float r[12] = { m.m[0], m.m[1], m.m[2],  0,
+			      m.m[4], m.m[5], m.m[6],  0,
+			      m.m[8], m.m[9], m.m[10], 0 };
+	ForEachChunk(n, [&](size_t begin, size_t end) {
+		TransformXYZ(r, &v[begin].x, &out[begin].x, end - begin);
+	});
+}
+
+// Normals use the transposed upper 3x3 of the inverse matrix
+void Transform::operator()(const Normal3f* nrm, size_t n, Normal3f* out) const {
+	const float r[12] = { mInv.m[0], mInv.m[4], mInv.m[8],  0,
+			      mInv.m[1], mInv.m[5], mInv.m[9],  0,
+			      mInv.m[2], mInv.m[6], mInv.m[10], 0 };
+	ForEachChunk(n, [&](size_t begin, size_t end) {
+		TransformXYZ(r, &nrm[begin].x, &out[begin].x, end - begin);
+	});
+}
+
 }
@@ -8,12 +8,14 @@
 #include "normal3.h"
 #include "ray.h"
 #include "interaction.h"
+#include "bounds3.h"
+#include "quaternion.h"
 
 namespace apollo {
 
 class Transform {
 	public:
-		Transform() {}
+		Transform() : affine(true) {}
 		Transform(const Matrix& m);
 		Transform(const Matrix& m, const Matrix& mInv);
 
@@ -29,22 +31,75 @@ class Transform {
 		// Check if a transformation changes coordinate system handedness
 		bool ChangesHandedness() const;
 
+		// Check if the projective row of the matrix is (0, 0, 0, 1)
+		bool IsAffine() const { return affine; }
+
 		// Transformations composition
 		Transform operator*(const Transform& t) const;
 
+		// Compare transformations
+		bool operator==(const Transform& t) const { return t.m == m && t.mInv == mInv; }
+		bool operator!=(const Transform& t) const { return t.m != m || t.mInv != mInv; }
+
 		// Apply transformation to geometries
 		// ==================================
 		template <typename T> inline Point3<T>  operator()(const Point3<T>& p)  const;
+		// Transform a point carrying absolute error pError, bounding the error of the result in pTransError
+		template <typename T> inline Point3<T>  operator()(const Point3<T>& p, const Vector3<T>& pError, Vector3<T>* pTransError) const;
 		template <typename T> inline Vector3<T> operator()(const Vector3<T>& v) const;
 		template <typename T> inline Normal3<T> operator()(const Normal3<T>& n) const;
 		inline Ray operator()(const Ray& r) const;
 		SurfaceInteraction operator()(const SurfaceInteraction& s) const;
 
+		// Apply transformation to arrays of n geometries (out may alias in)
+		// Large arrays are split across all threads
+		void operator()(const Point3f* p, size_t n, Point3f* out) const;
+		void operator()(const Vector3f* v, size_t n, Vector3f* out) const;
+		void operator()(const Normal3f* nrm, size_t n, Normal3f* out) const;
+
 	private:
 		// Transform private data
 		// Matrix and Inverse matrix of the transformation
 		Matrix m;
 		Matrix mInv;
+
+		// Cached on construction; affine transforms skip the homogeneous divide
+		bool affine;
+};
+
+// Transformation moving between two keyframes over [startTime, endTime]
+// Both keyframes are decomposed into translation, rotation and scale, which are interpolated separately (the rotation
+// by slerp), so rigid motion stays rigid instead of shearing as a blend of the matrices would
+class AnimatedTransform {
+	public:
+		AnimatedTransform(const Transform& startTransform, float startTime, const Transform& endTransform, float endTime);
+
+		// Transformation at the given time; times outside the keyframe interval clamp to the nearest keyframe
+		Transform Interpolate(float time) const;
+
+		// Check if the keyframes differ
+		bool IsAnimated() const { return animated; }
+
+		// Box swept by transforming b over the keyframe interval
+		Bounds3f MotionBounds(const Bounds3f& b) const;
+
+		// Boxes at time0 and time1 whose linear interpolation contains the transformed b at every time in between
+		void LinearMotionBounds(const Bounds3f& b, float time0, float time1, Bounds3f* b0, Bounds3f* b1) const;
+
+		// Keyframe times
+		const float startTime, endTime;
+
+	private:
+		// Split an affine matrix into translation, rotation and the remaining scale (and shear) such that m = T * R * S
+		static void Decompose(const Matrix& m, Vector3f* T, Quaternion* R, Matrix* S);
+
+		const Transform startTransform, endTransform;
+		bool animated;
+
+		// Decomposed keyframes
+		Vector3f T[2];
+		Quaternion R[2];
+		Matrix S[2];
 };
 
 // Common Transformations
@@ -60,17 +115,36 @@ Transform RotateZ(float theta);
 // Camera Look-at transformation (used to convert from camera to world space)
 Transform LookAt(const Point3f& pos, const Point3f& look, const Vector3f& up);
 
+// Bounding box of a transformed box
+Bounds3f TransformBounds(const Transform& t, const Bounds3f& b);
+
 // Apply transformation to geometries
 // ==================================
 template <typename T> inline Point3<T> Transform::operator()(const Point3<T>& p) const {
 	const T x = m.m[0]*p.x + m.m[1]*p.y + m.m[2]*p.z + m.m[3];
 	const T y = m.m[4]*p.x + m.m[5]*p.y + m.m[6]*p.z + m.m[7];
 	const T z = m.m[8]*p.x + m.m[9]*p.y + m.m[10]*p.z + m.m[11];
+
+	if (affine)
+		return Point3<T>(x, y, z);
+
 	const T weight = m.m[12]*p.x + m.m[13]*p.y + m.m[14]*p.z + m.m[15];
 
 	return weight == 1 ? Point3<T>(x, y, z) : Point3<T>(x, y, z) * (1.0f / weight);
 }
 
+// The rounding error of the matrix-vector product is bounded by gamma(3) times the sum of the absolute
+// terms; incoming error is carried through the matrix (scaled up by one more rounding)
+template <typename T> inline Point3<T> Transform::operator()(const Point3<T>& p, const Vector3<T>& pError, Vector3<T>* pTransError) const {
+	for (int i = 0; i < 3; i++) {
+		const float* r = &m.m[4*i];
+		(*pTransError)[i] = (Gamma(3) + 1) * (std::abs(r[0])*pError.x + std::abs(r[1])*pError.y + std::abs(r[2])*pError.z) +
+				    Gamma(3) * (std::abs(r[0]*p.x) + std::abs(r[1]*p.y) + std::abs(r[2]*p.z) + std::abs(r[3]));
+	}
+
+	return (*this)(p);
+}
+
 template <typename T> inline Vector3<T> Transform::operator()(const Vector3<T>& v) const {
 	const T x = m.m[0]*v.x + m.m[1]*v.y + m.m[2]*v.z;
 	const T y = m.m[4]*v.x + m.m[5]*v.y + m.m[6]*v.z;
@@ -79,12 +153,12 @@ template <typename T> inline Vector3<T> Transform::operator()(const Vector3<T>&
 	return Vector3<T>(x, y, z);
 }
 
+// Normals are transformed by the inverse transpose; the upper 3x3 of mInv
+// is read column-wise instead of building a transposed copy
 template <typename T> inline Normal3<T> Transform::operator()(const Normal3<T>& n) const {
-	Matrix newM = mInv.Transpose();
-
-	const T x = newM.m[0]*n.x + newM.m[1]*n.y + newM.m[2]*n.z;
-	const T y = newM.m[4]*n.x + newM.m[5]*n.y + newM.m[6]*n.z;
-	const T z = newM.m[8]*n.x + newM.m[9]*n.y + newM.m[10]*n.z;
+	const T x = mInv.m[0]*n.x + mInv.m[4]*n.y + mInv.m[8]*n.z;
+	const T y = mInv.m[1]*n.x + mInv.m[5]*n.y + mInv.m[9]*n.z;
+	const T z = mInv.m[2]*n.x + mInv.m[6]*n.y + mInv.m[10]*n.z;
 
 	return Normal3<T>(x, y, z);
 }
@@ -188,6 +188,15 @@ template <typename T> inline Vector3<T> Cross(const Vector3<T> &v1, const Normal
 			  (v1x * n1y) - (v1y * n1x));
 }
 
+// Construct an orthonormal basis from a single normalized vector
+template <typename T> inline void CoordinateSystem(const Vector3<T> &v1, Vector3<T> *v2, Vector3<T> *v3) {
+	if (std::abs(v1.x) > std::abs(v1.y))
+		*v2 = Vector3<T>(-v1.z, 0, v1.x) / std::sqrt(v1.x * v1.x + v1.z * v1.z);
+	else
+		*v2 = Vector3<T>(0, v1.z, -v1.y) / std::sqrt(v1.y * v1.y + v1.z * v1.z);
+	*v3 = Cross(v1, *v2);
+}
+
 // Compare vector
 template <typename T> inline bool operator==(const Vector3<T> &v1, const Vector3<T> &v2) {
 	return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z;
@@ -3,8 +3,21 @@
 
 namespace apollo {
 
-Shape::Shape(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation)
+Shape::Shape(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation, ShapeType type)
 	: objectToWorld(objectToWorld), worldToObject(worldToObject), reverseOrientation(reverseOrientation),
-	  transformChangesHandedness(objectToWorld->ChangesHandedness()) {}
+	  transformChangesHandedness(objectToWorld->ChangesHandedness()), type(type) {}
+
+// Check if a shape is intersected by a ray
+bool Shape::Intersect(const Ray& ray, SurfaceInteraction* surf) const {
+	HitRecord hit;
+	if (!IntersectHit(ray, &hit))
+		return false;
+
+	if (surf) {
+		*surf = ComputeSurfaceInteraction(ray, hit);
+		ray.tMax = hit.t;
+	}
+	return true;
+}
 
 }
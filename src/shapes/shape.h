@@ -8,15 +8,38 @@
 #include "interaction.h"
 
 namespace apollo {
+
+// Minimal record of a ray-shape hit, filled in during traversal
+// The full SurfaceInteraction is only built for the closest hit
+struct HitRecord {
+	// Distance along the ray
+	float t;
+	// Shape specific surface coordinates (barycentrics of the second and third vertex for triangles)
+	float b1, b2;
+	// Hit primitive
+	const Primitive* primitive = nullptr;
+};
+
+// Concrete shape types known to the acceleration structures, which call them without virtual dispatch
+enum class ShapeType : uint8_t { Triangle, Sphere, Other };
+
 // General shape interface
 class Shape {
 	public:
-		Shape(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation);
+		Shape(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
+		      ShapeType type = ShapeType::Other);
 		
 		virtual ~Shape() {};
 
+		// Check if a shape is intersected by a ray within its extent; only fills in the hit record
+		virtual bool IntersectHit(const Ray& ray, HitRecord* hit) const = 0;
+
+		// Build the surface interaction for a hit found by IntersectHit
+		virtual SurfaceInteraction ComputeSurfaceInteraction(const Ray& ray, const HitRecord& hit) const = 0;
+
 		// Check if a shape is intersected by a ray
-		virtual bool Intersect(const Ray& ray, SurfaceInteraction* surf = nullptr) const = 0;
+		// If surf is given, it is filled in and the ray extent shrinks to the hit
+		bool Intersect(const Ray& ray, SurfaceInteraction* surf = nullptr) const;
 
 		// Shape bounding box in object coordinates
 		virtual Bounds3f ObjectBound() const = 0;
@@ -33,6 +56,8 @@ class Shape {
 		const bool reverseOrientation;
 		// Indicates whether object to world transformation changes coordinate system handedness
 		const bool transformChangesHandedness;
+		// Concrete type of the shape
+		const ShapeType type;
 }; 
 
 }
@@ -2,13 +2,100 @@
 #include "sphere.h"
 #include "vector3.h"
 #include "point3.h"
+#include "stats.h"
+#include "transformcache.h"
+#include <mutex>
 
 namespace apollo {
+	// Check if the upper 3x3 of an affine matrix is a rotation (or reflection) times a uniform scale;
+	// returns the scale factor
+	static bool IsSimilarity(const Matrix& m, float* scale) {
+		if (m.m[12] != 0.0f || m.m[13] != 0.0f || m.m[14] != 0.0f || m.m[15] != 1.0f)
+			return false;
+
+		const Vector3f c0(m.m[0], m.m[4], m.m[8]);
+		const Vector3f c1(m.m[1], m.m[5], m.m[9]);
+		const Vector3f c2(m.m[2], m.m[6], m.m[10]);
+		const float s2 = c0.LengthSquared();
+		const float tolerance = 1e-5f * s2;
+
+		// Columns must have equal length and be mutually orthogonal
+		if (s2 == 0.0f || std::abs(c1.LengthSquared() - s2) > tolerance || std::abs(c2.LengthSquared() - s2) > tolerance)
+			return false;
+		if (std::abs(Dot(c0, c1)) > tolerance || std::abs(Dot(c0, c2)) > tolerance || std::abs(Dot(c1, c2)) > tolerance)
+			return false;
+
+		*scale = std::sqrt(s2);
+		return true;
+	}
+
 	Sphere::Sphere(const Transform* objectToWorld, const Transform* worldToObject, 
 			bool reverseOrientation, float radius)
-		: Shape(objectToWorld, worldToObject, reverseOrientation), radius(radius) {}
+		: Shape(objectToWorld, worldToObject, reverseOrientation, ShapeType::Sphere), radius(radius), worldRadius(radius) {
+		float scale;
+		worldSpace = IsSimilarity(objectToWorld->GetMatrix(), &scale);
+		worldCenter = (*objectToWorld)(Point3f(0.0f));
+		if (worldSpace)
+			worldRadius = radius * scale;
+
+		// Under other transforms the sphere becomes an ellipsoid without a closed-form area
+		static std::once_flag warnOnce;
+		if (!worldSpace)
+			std::call_once(warnOnce, []() {
+				std::cerr << "Spheres under non-uniform scales report no area; area sampling and power estimates leave them out" << std::endl;
+			});
+	}
+
+	std::shared_ptr<Shape> CreateSphere(const Transform& objectToWorld, bool reverseOrientation, float radius) {
+		const Transform *toWorld, *toObject;
+		transformCache.Lookup(objectToWorld, &toWorld, &toObject);
+		return std::make_shared<Sphere>(toWorld, toObject, reverseOrientation, radius);
+	}
 	
-	bool Sphere::Intersect(const Ray& ray, SurfaceInteraction* surf) const {
+	// Record the nearest of the hit distances t0 <= t1 within the ray extent
+	static bool RecordNearestHit(const Ray& ray, float t0, float t1, HitRecord* hit) {
+		if (t0 > ray.tMax || t1 <= 0.0f)
+			return false;
+
+		const float tHit = t0 > 0.0f ? t0 : t1;
+		if (tHit > ray.tMax)
+			return false;
+
+		hit->t = tHit;
+		STAT_INC(SphereHits);
+		return true;
+	}
+
+	// Find the nearest hit distance within the ray extent
+	bool CompactSphere::IntersectHit(const Ray& ray, HitRecord* hit) const {
+		STAT_INC(SphereTests);
+
+		// Solve a*t^2 + 2*b*t + c = 0 for the ray against the world space sphere. The discriminant
+		// b^2 - a*c is computed from the distance between the center and the ray's closest point,
+		// which does not suffer from cancellation when the ray starts far from the sphere.
+		const Vector3f oc = ray.o - center;
+		const float a = ray.d.LengthSquared();
+		const float b = Dot(oc, ray.d);
+		const float c = oc.LengthSquared() - radius * radius;
+		const Vector3f l = oc - ray.d * (b / a);
+		const float discriminant = a * (radius - l.Length()) * (radius + l.Length());
+		if (discriminant < 0.0f)
+			return false;
+
+		const float q = -(b + std::copysign(std::sqrt(discriminant), b));
+		// q is only zero for the double root at zero, such as a ray leaving the surface along a tangent
+		float t1 = q / a, t0 = q != 0.0f ? c / q : t1;
+		if (t0 > t1)
+			std::swap(t0, t1);
+		return RecordNearestHit(ray, t0, t1, hit);
+	}
+
+	bool Sphere::IntersectHit(const Ray& ray, HitRecord* hit) const {
+		if (worldSpace)
+			return Compact().IntersectHit(ray, hit);
+
+		STAT_INC(SphereTests);
+
 		// Transform ray to object space
 		Ray r = (*worldToObject)(ray);
 		
@@ -21,41 +108,70 @@ namespace apollo {
 		float t0, t1;
 		if (!Quadratic(a, b, c, t0, t1))
 			return false;
-		
-		// Ensure solutions pass ray constraints	
-		if (t0 > r.tMax || t1 <= 0.0f)
-			return false;
+		return RecordNearestHit(ray, t0, t1, hit);
+	}
 
-		// Find nearest intersection
-		float tHit = t0;
-		if (tHit <= 0.0f) {
-			tHit = t1;
-			if (tHit > r.tMax)
-				return false;
-		}
-		
-		if (surf) {
-			// Compute sphere hit point
-			Point3f p = r(tHit);
+	// Build the surface interaction for a hit
+	// Derivatives of the object space point p = r (sin(theta) cos(phi), sin(theta) sin(phi), cos(theta)) with respect to
+	// (u, v) = (phi / 2pi, theta / pi)
+	static void ParametricDerivatives(const Point3f& p, float phi, Vector3f* dpdu, Vector3f* dpdv) {
+		*dpdu = Vector3f(-p.y, p.x, 0.0f) * (2*PI);
+		float radiusSinTheta = std::sqrt(p.x * p.x + p.y * p.y);
+		*dpdv = Vector3f(p.z * std::cos(phi), p.z * std::sin(phi), -radiusSinTheta) * PI;
+	}
 
-			// Compute theta and phi from hit point (sphere's parametric coordinates)
-			float theta = std::acos(Clamp(p.z / radius, -1.0f, 1.0f));
-			float phi = std::atan2(p.y, p.x);
+	SurfaceInteraction Sphere::ComputeSurfaceInteraction(const Ray& ray, const HitRecord& hit) const {
+		const float tHit = hit.t;
+		if (worldSpace) {
+			// Reproject the hit point onto the surface, which bounds its error
+			Vector3f offset = ray(tHit) - worldCenter;
+			offset *= worldRadius / offset.Length();
+			Point3f p = worldCenter + offset;
+			Vector3f pError = Vector3f(std::abs(offset.x) + std::abs(worldCenter.x),
+						   std::abs(offset.y) + std::abs(worldCenter.y),
+						   std::abs(offset.z) + std::abs(worldCenter.z)) * Gamma(6);
+
+			// Parametric coordinates come from the object space direction of the hit point
+			Vector3f dir = (*worldToObject)(offset);
+			float theta = std::acos(Clamp(dir.z / dir.Length(), -1.0f, 1.0f));
+			float phi = std::atan2(dir.y, dir.x);
 			if (phi < 0)
 				phi += 2*PI;
-		
-			// Compute (u, v) coords 
-			float u = phi / 2*PI;
-			float v = theta / PI;
-
-			// Find normal
-			Normal3f n = Normal3f(p.x, p.y, p.z);
 
-			// Initialize SurfaceInteraction
-			*surf = (*objectToWorld)(SurfaceInteraction(p, n, Point2f(u, v), -r.d, r.time, this));
+			Vector3f dpdu, dpdv;
+			ParametricDerivatives(Point3f(dir.x, dir.y, dir.z), phi, &dpdu, &dpdv);
+			dpdu = (*objectToWorld)(dpdu);
+			dpdv = (*objectToWorld)(dpdv);
+			const float invRadius = 1 / worldRadius;
+			return SurfaceInteraction(p, pError, Normal3f(offset.x, offset.y, offset.z), Point2f(phi / (2*PI), theta / PI), dpdu, dpdv,
+				Normal3f(dpdu * invRadius), Normal3f(dpdv * invRadius), -ray.d, ray.time, this);
 		}
 
-		return true;
+		// Compute sphere hit point in object space and reproject it onto the surface, which bounds its error
+		Ray r = (*worldToObject)(ray);
+		Point3f p = r(tHit);
+		p *= radius / Distance(p, Point3f(0.0f));
+		Vector3f pError = Vector3f(std::abs(p.x), std::abs(p.y), std::abs(p.z)) * Gamma(5);
+
+		// Compute theta and phi from hit point (sphere's parametric coordinates)
+		float theta = std::acos(Clamp(p.z / radius, -1.0f, 1.0f));
+		float phi = std::atan2(p.y, p.x);
+		if (phi < 0)
+			phi += 2*PI;
+	
+		// Compute (u, v) coords 
+		float u = phi / (2*PI);
+		float v = theta / PI;
+
+		// Find normal and its derivatives; the normalized normal is p / radius
+		Normal3f n = Normal3f(p.x, p.y, p.z);
+		Vector3f dpdu, dpdv;
+		ParametricDerivatives(p, phi, &dpdu, &dpdv);
+		const float invRadius = 1 / radius;
+
+		// Initialize SurfaceInteraction in object space and bring it to world space
+		return (*objectToWorld)(SurfaceInteraction(p, pError, n, Point2f(u, v), dpdu, dpdv, Normal3f(dpdu * invRadius), Normal3f(dpdv * invRadius),
+			-r.d, r.time, this));
 	}
 
 	Bounds3f Sphere::ObjectBound() const {
@@ -63,12 +179,16 @@ namespace apollo {
 	}
 	
 	Bounds3f Sphere::WorldBound() const {
-		Point3f center = (*objectToWorld)(Point3f(0.0f));
-		return Bounds3f(center - radius, center + radius);
+		if (worldSpace)
+			return Bounds3f(worldCenter - worldRadius, worldCenter + worldRadius);
+
+		return TransformBounds(*objectToWorld, ObjectBound());
 	}
 
+	// The world space area is only known in closed form for rigid and uniformly scaled spheres; ellipsoids made by
+	// other transforms report no area (the constructor warns about them)
 	float Sphere::Area() const {
-		return 4 * PI * radius * radius;
+		return worldSpace ? 4 * PI * worldRadius * worldRadius : 0.0f;
 	}
 
 } 
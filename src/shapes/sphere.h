@@ -6,26 +6,52 @@
 
 namespace apollo {
 
+// The data needed to intersect a sphere in world space, without the Shape base (vtable, transforms, flags)
+// Accelerators keep these in contiguous arrays for the leaf tests of rigid and uniformly scaled spheres
+struct CompactSphere {
+	// Same test and hit record as Sphere::IntersectHit
+	bool IntersectHit(const Ray& ray, HitRecord* hit) const;
+
+	Point3f center;
+	float radius;
+};
+
 // Sphere origin is always defined at the center of the coordinate system in object space
-class Sphere : public Shape {
+class Sphere final : public Shape {
 	public:
 		Sphere(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation, float radius); 
 			
-		// Check if a sphere is intersected by a ray
-		bool Intersect(const Ray& ray, SurfaceInteraction* surf = nullptr) const override;
+		// Check if a sphere is intersected by a ray (no trigonometry; only the distance is found)
+		bool IntersectHit(const Ray& ray, HitRecord* hit) const override;
+
+		// Build the surface interaction for a hit
+		SurfaceInteraction ComputeSurfaceInteraction(const Ray& ray, const HitRecord& hit) const override;
 
 		// Sphere bounding box in object coordinates
 		Bounds3f ObjectBound() const override;
 		// Sphere bounding box in world coordinates
 		Bounds3f WorldBound() const override;
 
-		// Sphere surface area
+		// Sphere surface area in world space (zero if the transform does not scale uniformly)
 		float Area() const override;
+
+		// Check if the sphere is intersected in world space, which is required for Compact()
+		bool IsWorldSpace() const { return worldSpace; }
+
+		// World space intersection data of the sphere
+		CompactSphere Compact() const { return { worldCenter, worldRadius }; }
 	private:
 		const float radius;
 
+		// Rigid and uniformly scaled spheres are intersected directly in world space
+		bool worldSpace;
+		Point3f worldCenter;
+		float worldRadius;
 };	
 
+// Sphere whose transform and its inverse are shared through the transform cache
+std::shared_ptr<Shape> CreateSphere(const Transform& objectToWorld, bool reverseOrientation, float radius);
+
 }
 
 #endif
@@ -2,6 +2,9 @@
 #include "triangle.h"
 #include "vector3.h"
 #include "normal3.h"
+#include "stats.h"
+#include "trace.h"
+#include "transformcache.h"
 
 namespace apollo {
 
@@ -9,13 +12,14 @@ namespace apollo {
 	TriangleMesh::TriangleMesh(const Transform& objectToWorld, int nTriangles, const int* vertexIndices, int nVertices, const Point3f* P) 
 		: nTriangles(nTriangles), nVertices(nVertices), vertexIndices(vertexIndices, vertexIndices + 3 * nTriangles) {
 		// Tranform vertices to world space
-		vertices.reserve(nVertices);
-		for (int i = 0; i < nVertices; i++)
-			vertices.push_back(objectToWorld(P[i]));
+		vertices.resize(nVertices);
+		objectToWorld(P, nVertices, vertices.data());
 	}
 
 	// Initialize mesh by parsing .obj file
 	TriangleMesh::TriangleMesh(const Transform& objectToWorld, const std::string& filename) {
+		STAT_PHASE(Load);
+		TRACE_SCOPE("Parse OBJ", "load");
 		std::ifstream in(filename);
 		nTriangles = 0;
 		nVertices = 0;
@@ -24,70 +28,165 @@ namespace apollo {
 			exit(1);
 		}
 
+		// Numbers are read straight from the line buffer, which getline reuses, so parsing does not allocate per line
 		std::string line;
 		while (std::getline(in, line)) {
-			std::string type;
-			std::istringstream iss(line);
+			const char* s = line.c_str();
+			while (*s == ' ' || *s == '\t')
+				s++;
 
-			iss >> type;
-
-			if (type == "v") {
+			if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+				char* end;
 				Point3f vertex;
-				iss >> vertex.x;
-				iss >> vertex.y;
-				iss >> vertex.z;
-				vertices.push_back(objectToWorld(vertex));
+				vertex.x = std::strtof(s + 1, &end);
+				vertex.y = std::strtof(end, &end);
+				vertex.z = std::strtof(end, &end);
+				vertices.push_back(vertex);
 				nVertices++;
 			}
 			
-			else if (type == "f") {
-				Point3i face;
-				iss >> face.x;
-				iss >> face.y;
-				iss >> face.z;
-				vertexIndices.push_back(face.x - 1);
-				vertexIndices.push_back(face.y - 1);
-				vertexIndices.push_back(face.z - 1);
+			else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+				// Only the position index of every vertex is used; texture and normal indices after '/' are skipped
+				char* end = const_cast<char*>(s + 1);
+				for (int k = 0; k < 3; k++) {
+					vertexIndices.push_back((int)std::strtol(end, &end, 10) - 1);
+					while (*end && *end != ' ' && *end != '\t')
+						end++;
+				}
 				nTriangles++;
 			}
 		}
+
+		// Tranform vertices to world space
+		objectToWorld(vertices.data(), vertices.size(), vertices.data());
 	}
 
-	std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-		int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p) {
-		std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(*objectToWorld, nTriangles, vertexIndicies, nVerticies, p);
+	// A mesh together with its triangles
+	struct TriangleMeshBlock {
+		template <typename... Args>
+		TriangleMeshBlock(Args&&... args) : mesh(std::forward<Args>(args)...) {}
+
+		TriangleMesh mesh;
+		std::vector<Triangle> triangles;
+	};
+
+	// Create the triangles of the block's mesh in one array and hand them out through pointers aliasing the block
+	static std::vector<std::shared_ptr<Shape>> CreateTriangles(const std::shared_ptr<TriangleMeshBlock>& block, const Transform* objectToWorld,
+		const Transform* worldToObject, bool reverseOrientation, const TriangleMeshOptions& options) {
+		TriangleMesh& mesh = block->mesh;
+		mesh.options = options;
+		block->triangles.reserve(mesh.nTriangles);
+		for (int i = 0; i < mesh.nTriangles; i++)
+			block->triangles.emplace_back(objectToWorld, worldToObject, reverseOrientation, &mesh, i);
+
 		std::vector<std::shared_ptr<Shape>> triangles;
-		triangles.reserve(nTriangles);
-		for (int i = 0; i < nTriangles; i++)
-			triangles.push_back(std::make_shared<Triangle>(objectToWorld, worldToObject, reverseOrientation, mesh, i));
+		triangles.reserve(mesh.nTriangles);
+		for (Triangle& triangle : block->triangles)
+			triangles.push_back(std::shared_ptr<Shape>(block, &triangle));
 		return triangles;
 	}
 
+	std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
+		int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p, const TriangleMeshOptions& options) {
+		std::shared_ptr<TriangleMeshBlock> block = std::make_shared<TriangleMeshBlock>(*objectToWorld, nTriangles, vertexIndicies, nVerticies, p);
+		return CreateTriangles(block, objectToWorld, worldToObject, reverseOrientation, options);
+	}
+
 	std::vector<std::shared_ptr<Shape>> CreateTriangleMeshByObj(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-		const std::string& filename) {
-		std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(*objectToWorld, filename);
-		std::vector<std::shared_ptr<Shape>> triangles;
-		triangles.reserve(mesh->nTriangles);
-		for (int i = 0; i < mesh->nTriangles; i++)
-			triangles.push_back(std::make_shared<Triangle>(objectToWorld, worldToObject, reverseOrientation, mesh, i));
+		const std::string& filename, const TriangleMeshOptions& options) {
+		std::shared_ptr<TriangleMeshBlock> block = std::make_shared<TriangleMeshBlock>(*objectToWorld, filename);
+		return CreateTriangles(block, objectToWorld, worldToObject, reverseOrientation, options);
+	}
 
-		return triangles;
+	std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(const Transform& objectToWorld, bool reverseOrientation,
+		int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p, const TriangleMeshOptions& options) {
+		const Transform *toWorld, *toObject;
+		transformCache.Lookup(objectToWorld, &toWorld, &toObject);
+		return CreateTriangleMesh(toWorld, toObject, reverseOrientation, nTriangles, vertexIndicies, nVerticies, p, options);
+	}
+
+	std::vector<std::shared_ptr<Shape>> CreateTriangleMeshByObj(const Transform& objectToWorld, bool reverseOrientation,
+		const std::string& filename, const TriangleMeshOptions& options) {
+		const Transform *toWorld, *toObject;
+		transformCache.Lookup(objectToWorld, &toWorld, &toObject);
+		return CreateTriangleMeshByObj(toWorld, toObject, reverseOrientation, filename, options);
 	}
 
 	Triangle::Triangle(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-		const std::shared_ptr<TriangleMesh>& mesh, int triangleIndex)
-		: Shape(objectToWorld, worldToObject, reverseOrientation), mesh(mesh) {
+		const TriangleMesh* mesh, int triangleIndex)
+		: Shape(objectToWorld, worldToObject, reverseOrientation, ShapeType::Triangle), mesh(mesh) {
 		v = &mesh->vertexIndices[3 * triangleIndex];
 	}
 
-	bool Triangle::Intersect(const Ray& ray, SurfaceInteraction* surf) const {
-		// Get triangle vertices
-		const Point3f& v0 = mesh->vertices[v[0]];
-		const Point3f& v1 = mesh->vertices[v[1]];
-		const Point3f& v2 = mesh->vertices[v[2]];
+	// Watertight ray-triangle intersection (Woop et al.)
+	// The vertices are moved into a space where the ray starts at the origin and runs along +z, using the shear
+	// constants cached in the ray. Hits are then decided by the signs of the 2D edge functions, which are evaluated
+	// identically for both triangles sharing an edge, so rays cannot slip through.
+	static bool IntersectWatertight(const Ray& ray, const Point3f& v0, const Point3f& v1, const Point3f& v2,
+		bool cullBackFaces, float* tHit, float* b0, float* b1, float* b2) {
+		const Vector3f p0 = v0 - ray.o, p1 = v1 - ray.o, p2 = v2 - ray.o;
+		const int kx = ray.kx, ky = ray.ky, kz = ray.kz;
+
+		const float p0x = p0[kx] + ray.Sx * p0[kz], p0y = p0[ky] + ray.Sy * p0[kz];
+		const float p1x = p1[kx] + ray.Sx * p1[kz], p1y = p1[ky] + ray.Sy * p1[kz];
+		const float p2x = p2[kx] + ray.Sx * p2[kz], p2y = p2[ky] + ray.Sy * p2[kz];
+
+		// Edge functions
+		float e0 = p1x * p2y - p1y * p2x;
+		float e1 = p2x * p0y - p2y * p0x;
+		float e2 = p0x * p1y - p0y * p1x;
+
+		// Recompute in double precision when the ray passes exactly through an edge
+		if (e0 == 0.0f || e1 == 0.0f || e2 == 0.0f) {
+			e0 = (float)((double)p1x * p2y - (double)p1y * p2x);
+			e1 = (float)((double)p2x * p0y - (double)p2y * p0x);
+			e2 = (float)((double)p0x * p1y - (double)p0y * p1x);
+		}
+
+		if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+			return false;
+		const float det = e0 + e1 + e2;
+		if (det == 0.0f)
+			return false;
+
+		// Front faces (clockwise as seen from the ray) have det of the same sign as the ray's z direction
+		if (cullBackFaces && det * ray.Sz < 0.0f)
+			return false;
+
+		// Scaled hit distance; compare against the ray extent before dividing by det
+		const float p0z = ray.Sz * p0[kz], p1z = ray.Sz * p1[kz], p2z = ray.Sz * p2[kz];
+		const float tScaled = e0 * p0z + e1 * p1z + e2 * p2z;
+		if (det < 0 && (tScaled >= 0 || tScaled < ray.tMax * det))
+			return false;
+		if (det > 0 && (tScaled <= 0 || tScaled > ray.tMax * det))
+			return false;
+
+		const float invDet = 1 / det;
+		const float t = tScaled * invDet;
+
+		// Reject hits closer than the rounding error of t
+		const float maxZt = std::max(std::abs(p0z), std::max(std::abs(p1z), std::abs(p2z)));
+		const float maxXt = std::max(std::abs(p0x), std::max(std::abs(p1x), std::abs(p2x)));
+		const float maxYt = std::max(std::abs(p0y), std::max(std::abs(p1y), std::abs(p2y)));
+		const float maxE = std::max(std::abs(e0), std::max(std::abs(e1), std::abs(e2)));
+		const float deltaZ = Gamma(3) * maxZt;
+		const float deltaX = Gamma(5) * (maxXt + maxZt);
+		const float deltaY = Gamma(5) * (maxYt + maxZt);
+		const float deltaE = 2 * (Gamma(2) * maxXt * maxYt + deltaY * maxXt + deltaX * maxYt);
+		const float deltaT = 3 * (Gamma(3) * maxE * maxZt + deltaE * maxZt + deltaZ * maxE) * std::abs(invDet);
+		if (t <= deltaT)
+			return false;
+
+		*tHit = t;
+		*b0 = e0 * invDet;
+		*b1 = e1 * invDet;
+		*b2 = e2 * invDet;
+		return true;
+	}
 
-		// Apply MllerTrumbore ray-triangle intersection algorithm
-		//==========================================================
+	// MllerTrumbore ray-triangle intersection
+	static bool IntersectMollerTrumbore(const Ray& ray, const Point3f& v0, const Point3f& v1, const Point3f& v2,
+		bool cullBackFaces, float* tHit, float* b0, float* b1, float* b2) {
 		Vector3f v0v1 = v1 - v0;
 		Vector3f v0v2 = v2 - v0;
 		Vector3f translation = ray.o - v0;
@@ -95,14 +194,14 @@ namespace apollo {
 		
 		float det = Dot(pvec, v0v2);
 		
-		// If determinant is close to 0, the ray and the triangle are parallel
-		if (det < Epsilon)
+		// If determinant is close to 0, the ray and the triangle are parallel (negative for back faces)
+		if (cullBackFaces ? det < Epsilon : std::abs(det) < Epsilon)
 			return false;
 
 		float invDet = 1 / det;
 		Vector3f qvec = Cross(translation, v0v2) * invDet;
 
-		// Compute barycentric coordinates
+		// Compute barycentric coordinates (u weights v2 and v weights v1)
 		float u = Dot(translation, pvec) * invDet;
 		if (u < 0 || u > 1)
 			return false;
@@ -111,18 +210,64 @@ namespace apollo {
 		if (v < 0 || u + v > 1)
 			return false;
 
-		// Initialize surface interaction (if defined)
-		if (surf) {
-			float tHit = Dot(v0v1, qvec) * invDet;
-			Point3f p = ray(tHit);
-			Normal3f n = Normal3(Cross(v0v1, v0v2));
+		// Ensure the hit lies within the ray extent (qvec is already scaled by 1 / det)
+		float t = Dot(v0v1, qvec);
+		if (t <= 0.0f || t > ray.tMax)
+			return false;
+
+		*tHit = t;
+		*b0 = 1 - u - v;
+		*b1 = v;
+		*b2 = u;
+		return true;
+	}
+
+	bool Triangle::IntersectHit(const Ray& ray, HitRecord* hit) const {
+		return Compact().IntersectHit(ray, hit);
+	}
+
+	bool CompactTriangle::IntersectHit(const Ray& ray, HitRecord* hit) const {
+		STAT_INC(TriangleTests);
+
+		// Get triangle vertices
+		const Point3f& v0 = mesh->vertices[v[0]];
+		const Point3f& v1 = mesh->vertices[v[1]];
+		const Point3f& v2 = mesh->vertices[v[2]];
 
-			*surf = SurfaceInteraction(p, n, Point2f(u, v), -ray.d, ray.time, this);
+		float tHit, b0, b1, b2;
+		const TriangleMeshOptions& options = mesh->options;
+		if (options.watertight) {
+			if (!IntersectWatertight(ray, v0, v1, v2, options.cullBackFaces, &tHit, &b0, &b1, &b2))
+				return false;
 		}
+		else if (!IntersectMollerTrumbore(ray, v0, v1, v2, options.cullBackFaces, &tHit, &b0, &b1, &b2))
+			return false;
 
+		hit->t = tHit;
+		hit->b1 = b1;
+		hit->b2 = b2;
+		STAT_INC(TriangleHits);
 		return true;
 	}
 
+	// Build the surface interaction for a hit
+	SurfaceInteraction Triangle::ComputeSurfaceInteraction(const Ray& ray, const HitRecord& hit) const {
+		const Point3f& v0 = mesh->vertices[v[0]];
+		const Point3f& v1 = mesh->vertices[v[1]];
+		const Point3f& v2 = mesh->vertices[v[2]];
+		const float b1 = hit.b1, b2 = hit.b2, b0 = 1 - b1 - b2;
+
+		// Interpolate the hit point from the vertices, which bounds its error
+		Point3f p = b0 * v0 + b1 * v1 + b2 * v2;
+		Vector3f pError = Vector3f(std::abs(b0 * v0.x) + std::abs(b1 * v1.x) + std::abs(b2 * v2.x),
+					   std::abs(b0 * v0.y) + std::abs(b1 * v1.y) + std::abs(b2 * v2.y),
+					   std::abs(b0 * v0.z) + std::abs(b1 * v1.z) + std::abs(b2 * v2.z)) * Gamma(7);
+		Normal3f n = Normal3(Cross(v1 - v0, v2 - v0));
+
+		// With (u, v) = (b2, b1) the position is v0 + u * (v2 - v0) + v * (v1 - v0); the normal is constant
+		return SurfaceInteraction(p, pError, n, Point2f(b2, b1), v2 - v0, v1 - v0, Normal3f(0.0f), Normal3f(0.0f), -ray.d, ray.time, this);
+	}
+
 	Bounds3f Triangle::ObjectBound() const {
 		const Point3f& v0 = mesh->vertices[v[0]];
 		const Point3f& v1 = mesh->vertices[v[1]];
@@ -147,4 +292,63 @@ namespace apollo {
 		return Cross(v0v1, v0v2).Length() * 0.5;
 	}
 
+
+	// Uniform barycentrics; the rounding error bound of the point is the same as for interpolated hit points
+	Interaction Triangle::Sample(const Point2f& u) const {
+		const Point3f& v0 = mesh->vertices[v[0]];
+		const Point3f& v1 = mesh->vertices[v[1]];
+		const Point3f& v2 = mesh->vertices[v[2]];
+		const Point2f b = UniformSampleTriangle(u);
+		const float b0 = b.x, b1 = b.y, b2 = 1 - b0 - b1;
+
+		Point3f p = b0 * v0 + b1 * v1 + b2 * v2;
+		Vector3f pError = Vector3f(std::abs(b0 * v0.x) + std::abs(b1 * v1.x) + std::abs(b2 * v2.x),
+					   std::abs(b0 * v0.y) + std::abs(b1 * v1.y) + std::abs(b2 * v2.y),
+					   std::abs(b0 * v0.z) + std::abs(b1 * v1.z) + std::abs(b2 * v2.z)) * Gamma(6);
+		Normal3f n = Normal3(Cross(v1 - v0, v2 - v0)).Normalized();
+		// Flip the normal the same way surface interactions do
+		if (reverseOrientation ^ transformChangesHandedness)
+			n *= -1;
+		return Interaction(p, pError, n, Vector3f(0.0f), 0.0f);
+	}
+
+	TriangleAreaSampler::TriangleAreaSampler(const std::vector<std::shared_ptr<Shape>>& shapes) {
+		std::vector<float> areas;
+		size_t nIgnored = 0;
+		for (size_t i = 0; i < shapes.size(); i++) {
+			const std::shared_ptr<Shape>& shape = shapes[i];
+			if (shape->type != ShapeType::Triangle) {
+				nIgnored++;
+				continue;
+			}
+			triangles.push_back(static_cast<const Triangle*>(shape.get()));
+			areas.push_back(shape->Area());
+			area += areas.back();
+
+			// Triangles of one mesh share an owner, so keeping one reference per run of equal owners is enough
+			if (owners.empty() || shape.owner_before(owners.back()) || owners.back().owner_before(shape))
+				owners.push_back(shape);
+		}
+		if (nIgnored > 0)
+			std::cerr << "Area sampler ignores " << nIgnored << " shapes that are not triangles" << std::endl;
+
+		// Without area, such as for an empty mesh or only degenerate triangles, there is nothing to sample
+		if (area > 0.0f)
+			areaTable = AliasTable(areas);
+		else
+			area = 0.0f;
+	}
+
+	// The triangle is chosen with probability area_i / area and the point with density 1 / area_i, so the density over
+	// all triangles is 1 / area
+	Interaction TriangleAreaSampler::Sample(float u, const Point2f& u2, float* pdf) const {
+		if (!IsValid()) {
+			*pdf = 0.0f;
+			return Interaction();
+		}
+		const int index = areaTable.Sample(u);
+		*pdf = 1 / area;
+		return triangles[index]->Sample(u2);
+	}
+
 }
\ No newline at end of file
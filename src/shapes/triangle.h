@@ -4,9 +4,18 @@
 #include "apollo.h"
 #include "shape.h"
 #include "point3.h"
+#include "sampling.h"
 
 namespace apollo {
 
+// Per-mesh intersection settings
+struct TriangleMeshOptions {
+	// Use the watertight (permute and shear) test instead of MllerTrumbore
+	bool watertight = true;
+	// Ignore hits on the back side of triangles; disable for two-sided geometry
+	bool cullBackFaces = true;
+};
+
 class TriangleMesh {
 public:
 	// Initialize mesh explicitly
@@ -19,23 +28,45 @@ public:
 	int nTriangles, nVertices;
 	std::vector<int> vertexIndices;
 	std::vector<Point3f> vertices;
+	TriangleMeshOptions options;
 };
 
 // NOTE: If the triangles are supposed to be front-facing, verticies must be specified in clockwise order (from the point of view of the camera) 
+// The mesh and all of its triangles are allocated as one block; the returned pointers share ownership of it, so the whole
+// mesh is released at once when the last of them goes away
 std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-	int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p);
+	int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p, const TriangleMeshOptions& options = TriangleMeshOptions());
 std::vector<std::shared_ptr<Shape>> CreateTriangleMeshByObj(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-	const std::string& filename);
+	const std::string& filename, const TriangleMeshOptions& options = TriangleMeshOptions());
+
+// Same as above, with the transform and its inverse shared through the transform cache
+std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(const Transform& objectToWorld, bool reverseOrientation,
+	int nTriangles, const int* vertexIndicies, int nVerticies, const Point3f* p, const TriangleMeshOptions& options = TriangleMeshOptions());
+std::vector<std::shared_ptr<Shape>> CreateTriangleMeshByObj(const Transform& objectToWorld, bool reverseOrientation,
+	const std::string& filename, const TriangleMeshOptions& options = TriangleMeshOptions());
 
-class Triangle : public Shape 
+// The data needed to intersect a triangle, without the Shape base (vtable, transforms, flags)
+// Accelerators keep these in contiguous arrays for their leaf tests
+struct CompactTriangle {
+	// Same test and hit record as Triangle::IntersectHit
+	bool IntersectHit(const Ray& ray, HitRecord* hit) const;
+
+	const TriangleMesh* mesh;
+	const int* v;
+};
+
+class Triangle final : public Shape 
 {
 public:
 	Triangle(const Transform* objectToWorld, const Transform* worldToObject, bool reverseOrientation,
-		const std::shared_ptr<TriangleMesh>& mesh, int triangleIndex);
+		const TriangleMesh* mesh, int triangleIndex);
 
-	// Check if a triangle is intersected by a ray
-	// Apollo implements the MllerTrumbore ray-triangle intersection algorithm
-	bool Intersect(const Ray& ray, SurfaceInteraction* surf = nullptr) const override;
+	// Check if a triangle is intersected by a ray; the hit record holds the barycentrics
+	// Uses the watertight test by default, or MllerTrumbore if the mesh options ask for it
+	bool IntersectHit(const Ray& ray, HitRecord* hit) const override;
+
+	// Build the surface interaction for a hit
+	SurfaceInteraction ComputeSurfaceInteraction(const Ray& ray, const HitRecord& hit) const override;
 
 	// Triangle bounding box in object coordinates
 	Bounds3f ObjectBound() const override;
@@ -44,11 +75,43 @@ public:
 
 	// Triangle surface area
 	float Area() const override;
+
+	// Point distributed uniformly over the triangle's area (the density is 1 / Area())
+	Interaction Sample(const Point2f& u) const;
+
+	// Intersection data of the triangle
+	CompactTriangle Compact() const { return { mesh, v }; }
 private:
-	std::shared_ptr<TriangleMesh> mesh;
+	// Mesh of the triangle; kept alive by the block CreateTriangleMesh allocates both in
+	const TriangleMesh* mesh;
 	const int* v;
 };
 
+// Samples points uniformly by area over a set of triangles, such as the triangles of an emissive mesh
+// Triangles are chosen in proportion to their area from an alias table, so a sample costs the same for any mesh size
+class TriangleAreaSampler {
+public:
+	// The shapes should all be triangles, as returned by CreateTriangleMesh; other shapes are reported and ignored
+	// The sampler shares ownership of the triangles, so the caller may release its own references
+	TriangleAreaSampler(const std::vector<std::shared_ptr<Shape>>& triangles);
+
+	// Point distributed uniformly over the total area; u selects the triangle and u2 the point on it
+	// pdf is the density with respect to area, and zero if the sampler is not valid
+	Interaction Sample(float u, const Point2f& u2, float* pdf) const;
+
+	// Total area of the triangles
+	float Area() const { return area; }
+
+	// Whether there is any area to sample
+	bool IsValid() const { return areaTable.size() > 0; }
+private:
+	std::vector<const Triangle*> triangles;
+	// Keep the triangles (and the mesh blocks they live in) alive
+	std::vector<std::shared_ptr<const void>> owners;
+	AliasTable areaTable;
+	float area = 0.0f;
+};
+
 }
 
 #endif
\ No newline at end of file
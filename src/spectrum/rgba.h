@@ -0,0 +1,123 @@
+#ifndef APOLLO_SPECTRUM_RGBA_H
+#define APOLLO_SPECTRUM_RGBA_H
+
+#include "apollo.h"
+#include "rgb.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace apollo {
+
+// Four lane RGB(A) color used for accumulation
+// ============================================
+// All four channels are updated by a single SIMD instruction; the fourth lane is carried along
+// (alpha or padding). Lane arithmetic matches RGB exactly, so sums are bit-identical.
+class alignas(16) RGBA {
+	public:
+		// Default constructor; Initializes (0, 0, 0, 0)
+		RGBA() {
+#if defined(__SSE__)
+			v = _mm_setzero_ps();
+#else
+			c[0] = c[1] = c[2] = c[3] = 0.0f;
+#endif
+		}
+
+		// Constructor from four float values
+		RGBA(float r, float g, float b, float a) {
+#if defined(__SSE__)
+			v = _mm_setr_ps(r, g, b, a);
+#else
+			c[0] = r; c[1] = g; c[2] = b; c[3] = a;
+#endif
+		}
+
+		// Constructor from RGB color
+		explicit RGBA(const RGB& color, float a = 0.0f) : RGBA(color.r, color.g, color.b, a) {}
+
+		// Get by index
+		float operator[](int i) const {
+#if defined(__SSE__)
+			alignas(16) float c[4];
+			_mm_store_ps(c, v);
+#endif
+			return c[i];
+		}
+
+		// Drop the fourth lane
+		RGB ToRGB() const {
+#if defined(__SSE__)
+			alignas(16) float c[4];
+			_mm_store_ps(c, v);
+#endif
+			return RGB(c[0], c[1], c[2]);
+		}
+
+		// Basic arithmetic operations
+		// ===========================
+		inline RGBA operator+(const RGBA& color) const {
+			RGBA result = *this;
+			return result += color;
+		}
+
+		inline RGBA& operator+=(const RGBA& color) {
+#if defined(__SSE__)
+			v = _mm_add_ps(v, color.v);
+#else
+			for (int i = 0; i < 4; i++)
+				c[i] += color.c[i];
+#endif
+			return *this;
+		}
+
+		inline RGBA operator*(const RGBA& color) const {
+			RGBA result = *this;
+			return result *= color;
+		}
+
+		inline RGBA& operator*=(const RGBA& color) {
+#if defined(__SSE__)
+			v = _mm_mul_ps(v, color.v);
+#else
+			for (int i = 0; i < 4; i++)
+				c[i] *= color.c[i];
+#endif
+			return *this;
+		}
+
+		inline RGBA operator*(float s) const {
+			RGBA result = *this;
+			return result *= s;
+		}
+
+		inline RGBA& operator*=(float s) {
+#if defined(__SSE__)
+			v = _mm_mul_ps(v, _mm_set1_ps(s));
+#else
+			for (int i = 0; i < 4; i++)
+				c[i] *= s;
+#endif
+			return *this;
+		}
+
+		inline RGBA operator/(float s) const {
+			return *this * (1.0f / s);
+		}
+
+		inline RGBA& operator+=(const RGB& color) {
+			return *this += RGBA(color);
+		}
+
+	private:
+#if defined(__SSE__)
+		__m128 v;
+#else
+		float c[4];
+#endif
+};
+
+}
+
+#endif
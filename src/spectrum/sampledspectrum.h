@@ -0,0 +1,192 @@
+#ifndef APOLLO_SPECTRUM_SAMPLEDSPECTRUM_H
+#define APOLLO_SPECTRUM_SAMPLEDSPECTRUM_H
+
+#include "apollo.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace apollo {
+
+// Number of wavelengths carried by every path (one SIMD lane each)
+static constexpr int NSpectrumSamples = 4;
+
+// Range of visible wavelengths in nm
+static constexpr float LambdaMin = 360.0f, LambdaMax = 830.0f;
+
+// Spectral quantity at the NSpectrumSamples wavelengths of a path
+// ===============================================================
+class alignas(16) SampledSpectrum {
+	public:
+		// Default constructor; Initializes 0 at all wavelengths
+		SampledSpectrum() {
+#if defined(__SSE__)
+			v = _mm_setzero_ps();
+#else
+			for (int i = 0; i < NSpectrumSamples; i++)
+				c[i] = 0.0f;
+#endif
+		}
+
+		// Constructor from single float; Initializes u at all wavelengths
+		explicit SampledSpectrum(float u) {
+#if defined(__SSE__)
+			v = _mm_set1_ps(u);
+#else
+			for (int i = 0; i < NSpectrumSamples; i++)
+				c[i] = u;
+#endif
+		}
+
+		// Constructor from NSpectrumSamples values
+		explicit SampledSpectrum(const float* values) {
+#if defined(__SSE__)
+			v = _mm_loadu_ps(values);
+#else
+			for (int i = 0; i < NSpectrumSamples; i++)
+				c[i] = values[i];
+#endif
+		}
+
+		// Get by index
+		float operator[](int i) const {
+#if defined(__SSE__)
+			alignas(16) float c[NSpectrumSamples];
+			_mm_store_ps(c, v);
+#endif
+			return c[i];
+		}
+
+		// Store all values to an array of NSpectrumSamples floats
+		void Store(float* values) const {
+#if defined(__SSE__)
+			_mm_storeu_ps(values, v);
+#else
+			for (int i = 0; i < NSpectrumSamples; i++)
+				values[i] = c[i];
+#endif
+		}
+
+		float MaxComponent() const {
+			float values[NSpectrumSamples];
+			Store(values);
+			return *std::max_element(values, values + NSpectrumSamples);
+		}
+
+		// Basic arithmetic operations
+		// ===========================
+#if defined(__SSE__)
+#define APOLLO_SPECTRUM_OP(op, intrinsic)                                        \
+		inline SampledSpectrum& operator op##=(const SampledSpectrum& s) {       \
+			v = intrinsic(v, s.v);                                               \
+			return *this;                                                        \
+		}
+#else
+#define APOLLO_SPECTRUM_OP(op, intrinsic)                                        \
+		inline SampledSpectrum& operator op##=(const SampledSpectrum& s) {       \
+			for (int i = 0; i < NSpectrumSamples; i++)                           \
+				c[i] op##= s.c[i];                                               \
+			return *this;                                                        \
+		}
+#endif
+		APOLLO_SPECTRUM_OP(+, _mm_add_ps)
+		APOLLO_SPECTRUM_OP(-, _mm_sub_ps)
+		APOLLO_SPECTRUM_OP(*, _mm_mul_ps)
+		APOLLO_SPECTRUM_OP(/, _mm_div_ps)
+#undef APOLLO_SPECTRUM_OP
+
+		inline SampledSpectrum operator+(const SampledSpectrum& s) const { SampledSpectrum r = *this; return r += s; }
+		inline SampledSpectrum operator-(const SampledSpectrum& s) const { SampledSpectrum r = *this; return r -= s; }
+		inline SampledSpectrum operator*(const SampledSpectrum& s) const { SampledSpectrum r = *this; return r *= s; }
+		inline SampledSpectrum operator/(const SampledSpectrum& s) const { SampledSpectrum r = *this; return r /= s; }
+
+		inline SampledSpectrum& operator+=(float u) { return *this += SampledSpectrum(u); }
+		inline SampledSpectrum& operator*=(float u) { return *this *= SampledSpectrum(u); }
+		inline SampledSpectrum operator+(float u) const { return *this + SampledSpectrum(u); }
+		inline SampledSpectrum operator*(float u) const { return *this * SampledSpectrum(u); }
+		inline SampledSpectrum operator/(float u) const { return *this * (1.0f / u); }
+
+		// Square root at every wavelength
+		SampledSpectrum Sqrt() const {
+			SampledSpectrum r;
+#if defined(__SSE__)
+			r.v = _mm_sqrt_ps(v);
+#else
+			for (int i = 0; i < NSpectrumSamples; i++)
+				r.c[i] = std::sqrt(c[i]);
+#endif
+			return r;
+		}
+
+	private:
+#if defined(__SSE__)
+		__m128 v;
+#else
+		float c[NSpectrumSamples];
+#endif
+};
+
+inline SampledSpectrum operator*(float u, const SampledSpectrum& s) {
+	return s * u;
+}
+
+// Wavelengths carried by a path, chosen with hero wavelength sampling (Wilkie et al.)
+// The hero wavelength is uniform over the visible range and the others are spaced evenly after it, wrapping
+// around at LambdaMax, so all of them share the same pdf and every lane is a valid estimate on its own
+class SampledWavelengths {
+	public:
+		// Sample the wavelengths for u in [0, 1)
+		static SampledWavelengths SampleUniform(float u) {
+			const float range = LambdaMax - LambdaMin;
+			const float delta = range / NSpectrumSamples;
+			float lambda[NSpectrumSamples];
+			lambda[0] = Lerp(u, LambdaMin, LambdaMax);
+			for (int i = 1; i < NSpectrumSamples; i++) {
+				lambda[i] = lambda[i - 1] + delta;
+				if (lambda[i] > LambdaMax)
+					lambda[i] -= range;
+			}
+
+			SampledWavelengths wavelengths;
+			wavelengths.lambda = SampledSpectrum(lambda);
+			wavelengths.pdf = SampledSpectrum(1.0f / range);
+			return wavelengths;
+		}
+
+		// Wavelength in nm
+		float operator[](int i) const { return lambda[i]; }
+
+		// All wavelengths in nm
+		const SampledSpectrum& Lambda() const { return lambda; }
+
+		// Probability density of every wavelength (0 for terminated ones)
+		const SampledSpectrum& PDF() const { return pdf; }
+
+		// Drop all but the hero wavelength; called when scattering depends on the wavelength (e.g. dispersion)
+		// so the lanes no longer follow the same path
+		void TerminateSecondary() {
+			if (SecondaryTerminated())
+				return;
+			float p[NSpectrumSamples];
+			pdf.Store(p);
+			p[0] /= NSpectrumSamples;
+			for (int i = 1; i < NSpectrumSamples; i++)
+				p[i] = 0.0f;
+			pdf = SampledSpectrum(p);
+		}
+
+		bool SecondaryTerminated() const {
+			for (int i = 1; i < NSpectrumSamples; i++)
+				if (pdf[i] != 0.0f)
+					return false;
+			return true;
+		}
+
+	private:
+		SampledSpectrum lambda, pdf;
+};
+
+}
+
+#endif
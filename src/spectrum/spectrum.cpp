@@ -0,0 +1,314 @@
+#include "spectrum.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace apollo {
+
+// Color matching functions
+// ========================
+
+// Number of 1 nm table entries over the visible range
+static const int ColorMatchingSize = (int)(LambdaMax - LambdaMin) + 1;
+
+// Tabulated CIE 1931 color matching functions and the matrix from XYZ to RGB
+struct ColorMatching {
+	float x[ColorMatchingSize], y[ColorMatchingSize], z[ColorMatchingSize];
+	// Integral of y over the visible range
+	double yIntegral;
+	double xyzToRGB[3][3];
+};
+
+// Piecewise Gaussian with different widths left and right of its mean
+static double Lobe(double lambda, double mu, double sigmaLeft, double sigmaRight) {
+	double t = (lambda - mu) / (lambda < mu ? sigmaLeft : sigmaRight);
+	return std::exp(-0.5 * t * t);
+}
+
+// Invert a 3x3 matrix; returns false if it is singular
+static bool Invert3x3(const double m[3][3], double inv[3][3]) {
+	double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	double det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+	if (det == 0.0 || !std::isfinite(det))
+		return false;
+	double invDet = 1.0 / det;
+	inv[0][0] = c00 * invDet;
+	inv[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+	inv[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+	inv[1][0] = c01 * invDet;
+	inv[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+	inv[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+	inv[2][0] = c02 * invDet;
+	inv[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+	inv[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+	return true;
+}
+
+static ColorMatching BuildColorMatching() {
+	ColorMatching cm;
+	double integral[3] = { 0.0, 0.0, 0.0 };
+	for (int i = 0; i < ColorMatchingSize; i++) {
+		double lambda = LambdaMin + i;
+		double x = 1.056 * Lobe(lambda, 599.8, 37.9, 31.0) + 0.362 * Lobe(lambda, 442.0, 16.0, 26.7) - 0.065 * Lobe(lambda, 501.1, 20.4, 26.2);
+		double y = 0.821 * Lobe(lambda, 568.8, 46.9, 40.5) + 0.286 * Lobe(lambda, 530.9, 16.3, 31.1);
+		double z = 1.217 * Lobe(lambda, 437.0, 11.8, 36.0) + 0.681 * Lobe(lambda, 459.0, 26.0, 13.8);
+		cm.x[i] = (float)x;
+		cm.y[i] = (float)y;
+		cm.z[i] = (float)z;
+
+		// Trapezoidal rule
+		double w = (i == 0 || i == ColorMatchingSize - 1) ? 0.5 : 1.0;
+		integral[0] += w * x;
+		integral[1] += w * y;
+		integral[2] += w * z;
+	}
+	cm.yIntegral = integral[1];
+
+	// RGB to XYZ from the chromaticities of the sRGB primaries, scaled so that (1, 1, 1) maps to the XYZ of a constant spectrum
+	const double primaries[3][2] = { { 0.64, 0.33 }, { 0.30, 0.60 }, { 0.15, 0.06 } };
+	const double white[3] = { integral[0] / integral[1], 1.0, integral[2] / integral[1] };
+	double p[3][3], pInv[3][3];
+	for (int c = 0; c < 3; c++) {
+		p[0][c] = primaries[c][0] / primaries[c][1];
+		p[1][c] = 1.0;
+		p[2][c] = (1.0 - primaries[c][0] - primaries[c][1]) / primaries[c][1];
+	}
+	Invert3x3(p, pInv);
+
+	double rgbToXYZ[3][3];
+	for (int c = 0; c < 3; c++) {
+		double scale = pInv[c][0] * white[0] + pInv[c][1] * white[1] + pInv[c][2] * white[2];
+		for (int r = 0; r < 3; r++)
+			rgbToXYZ[r][c] = p[r][c] * scale;
+	}
+	Invert3x3(rgbToXYZ, cm.xyzToRGB);
+	return cm;
+}
+
+static const ColorMatching& GetColorMatching() {
+	static const ColorMatching cm = BuildColorMatching();
+	return cm;
+}
+
+// Estimate the RGB color of a spectrum sampled at the given wavelengths
+RGB SpectrumToRGB(const SampledSpectrum& s, const SampledWavelengths& lambda) {
+	const ColorMatching& cm = GetColorMatching();
+	float values[NSpectrumSamples], pdf[NSpectrumSamples];
+	s.Store(values);
+	lambda.PDF().Store(pdf);
+
+	float xyz[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < NSpectrumSamples; i++) {
+		if (pdf[i] == 0.0f)
+			continue;
+		float t = lambda[i] - LambdaMin;
+		int k = Clamp((int)t, 0, ColorMatchingSize - 2);
+		float f = t - k;
+		float w = values[i] / pdf[i];
+		xyz[0] += w * Lerp(f, cm.x[k], cm.x[k + 1]);
+		xyz[1] += w * Lerp(f, cm.y[k], cm.y[k + 1]);
+		xyz[2] += w * Lerp(f, cm.z[k], cm.z[k + 1]);
+	}
+
+	const float scale = (float)(1.0 / (NSpectrumSamples * cm.yIntegral));
+	RGB rgb;
+	for (int r = 0; r < 3; r++)
+		rgb[r] = (float)(cm.xyzToRGB[r][0] * xyz[0] + cm.xyzToRGB[r][1] * xyz[1] + cm.xyzToRGB[r][2] * xyz[2]) * scale;
+	return rgb;
+}
+
+// Sigmoid polynomial spectra
+// ==========================
+
+SampledSpectrum RGBSigmoidPolynomial::Evaluate(const SampledWavelengths& lambda) const {
+	SampledSpectrum t = (lambda.Lambda() + (-LambdaMin)) * (1.0f / (LambdaMax - LambdaMin));
+	SampledSpectrum x = (t * c0 + c1) * t + c2;
+	return x / (x * x + 1.0f).Sqrt() * 0.5f + 0.5f;
+}
+
+float RGBSigmoidPolynomial::Evaluate(float lambda) const {
+	float t = (lambda - LambdaMin) / (LambdaMax - LambdaMin);
+	float x = (t * c0 + c1) * t + c2;
+	return 0.5f + 0.5f * x / std::sqrt(x * x + 1.0f);
+}
+
+// Coefficients are clamped to keep the fit of colors on the gamut boundary finite
+static const double MaxCoefficient = 200.0;
+
+// Wavelengths the fit integrates over, with their RGB weights
+struct SpectrumFit {
+	static const int Step = 5;
+	static const int Size = (ColorMatchingSize - 1) / Step + 1;
+	double t[Size];
+	double weight[Size][3];
+};
+
+static SpectrumFit BuildSpectrumFit() {
+	const ColorMatching& cm = GetColorMatching();
+	SpectrumFit fit;
+	for (int i = 0; i < SpectrumFit::Size; i++) {
+		int k = i * SpectrumFit::Step;
+		fit.t[i] = (double)k / (ColorMatchingSize - 1);
+		double w = SpectrumFit::Step * ((i == 0 || i == SpectrumFit::Size - 1) ? 0.5 : 1.0) / cm.yIntegral;
+		for (int r = 0; r < 3; r++)
+			fit.weight[i][r] = w * (cm.xyzToRGB[r][0] * cm.x[k] + cm.xyzToRGB[r][1] * cm.y[k] + cm.xyzToRGB[r][2] * cm.z[k]);
+	}
+	return fit;
+}
+
+// RGB color of the sigmoid polynomial spectrum with coefficients c
+static void SigmoidPolynomialRGB(const SpectrumFit& fit, const double c[3], double rgb[3]) {
+	rgb[0] = rgb[1] = rgb[2] = 0.0;
+	for (int i = 0; i < SpectrumFit::Size; i++) {
+		double t = fit.t[i];
+		double x = (c[0] * t + c[1]) * t + c[2];
+		double s = 0.5 + 0.5 * x / std::sqrt(x * x + 1.0);
+		for (int r = 0; r < 3; r++)
+			rgb[r] += s * fit.weight[i][r];
+	}
+}
+
+// Squared distance between the color of coefficients c and the target; the color is returned in rgb
+static double FitError(const SpectrumFit& fit, const double c[3], const double target[3], double rgb[3]) {
+	SigmoidPolynomialRGB(fit, c, rgb);
+	double error = 0.0;
+	for (int r = 0; r < 3; r++)
+		error += (rgb[r] - target[r]) * (rgb[r] - target[r]);
+	return error;
+}
+
+// Refine c with Gauss-Newton until its spectrum reproduces the target color
+// Steps are halved until they reduce the error, since full steps oscillate for saturated colors
+static void FitCoefficients(const SpectrumFit& fit, const double target[3], double c[3]) {
+	const double h = 1e-5;
+	double rgb[3];
+	double error = FitError(fit, c, target, rgb);
+	for (int iteration = 0; iteration < 30 && error > 1e-12; iteration++) {
+		// Jacobian by forward differences
+		double J[3][3], JInv[3][3];
+		for (int j = 0; j < 3; j++) {
+			double cj[3] = { c[0], c[1], c[2] }, rgbj[3];
+			cj[j] += h;
+			SigmoidPolynomialRGB(fit, cj, rgbj);
+			for (int r = 0; r < 3; r++)
+				J[r][j] = (rgbj[r] - rgb[r]) / h;
+		}
+		if (!Invert3x3(J, JInv))
+			break;
+
+		double step[3];
+		for (int j = 0; j < 3; j++)
+			step[j] = JInv[j][0] * (rgb[0] - target[0]) + JInv[j][1] * (rgb[1] - target[1]) + JInv[j][2] * (rgb[2] - target[2]);
+
+		bool improved = false;
+		for (double scale = 1.0; scale > 1e-3 && !improved; scale *= 0.5) {
+			double cNew[3], rgbNew[3], maxC = 0.0;
+			for (int j = 0; j < 3; j++) {
+				cNew[j] = c[j] - scale * step[j];
+				maxC = std::max(maxC, std::abs(cNew[j]));
+			}
+			if (maxC > MaxCoefficient)
+				for (int j = 0; j < 3; j++)
+					cNew[j] *= MaxCoefficient / maxC;
+
+			double errorNew = FitError(fit, cNew, target, rgbNew);
+			if (errorNew < error) {
+				std::copy(cNew, cNew + 3, c);
+				std::copy(rgbNew, rgbNew + 3, rgb);
+				error = errorNew;
+				improved = true;
+			}
+		}
+		if (!improved)
+			break;
+	}
+}
+
+static float SmoothStep(float x) {
+	return x * x * (3.0f - 2.0f * x);
+}
+
+RGBToSpectrumTable::RGBToSpectrumTable() {
+	TRACE_SCOPE("Fit RGB to spectrum table", "load");
+	const int res = Resolution;
+	for (int k = 0; k < res; k++)
+		zNodes[k] = SmoothStep(SmoothStep((float)k / (res - 1)));
+	coefficients.resize(3 * res * res * res * 3);
+
+	const SpectrumFit fit = BuildSpectrumFit();
+
+	// Every (largest component, x, y) column is fitted outwards from a mid-range z, starting each fit from the previous solution
+	ParallelFor([&](int64_t column) {
+		const int l = (int)(column / (res * res));
+		const int j = (int)(column / res) % res;
+		const int i = (int)(column % res);
+		const double x = (double)i / (res - 1), y = (double)j / (res - 1);
+		const int start = res / 5;
+
+		auto fitRange = [&](int from, int to, int step) {
+			double c[3] = { 0.0, 0.0, 0.0 };
+			for (int k = from; k != to; k += step) {
+				double z = zNodes[k], target[3];
+				target[l] = z;
+				target[(l + 1) % 3] = x * z;
+				target[(l + 2) % 3] = y * z;
+				FitCoefficients(fit, target, c);
+
+				float* out = &coefficients[((((size_t)l * res + k) * res + j) * res + i) * 3];
+				for (int n = 0; n < 3; n++)
+					out[n] = (float)c[n];
+			}
+		};
+		fitRange(start, res, 1);
+		fitRange(start, -1, -1);
+	}, 3 * res * res);
+}
+
+const RGBToSpectrumTable& RGBToSpectrumTable::Get() {
+	static const RGBToSpectrumTable table;
+	return table;
+}
+
+// Spectrum of a reflectance color in [0, 1]
+RGBSigmoidPolynomial RGBToSpectrumTable::operator()(const RGB& color) const {
+	const RGB rgb = color.Clamp(0.0f, 1.0f);
+
+	// Grays are reproduced exactly by a constant spectrum
+	if (rgb.r == rgb.g && rgb.g == rgb.b) {
+		float c2 = (rgb.r - 0.5f) / std::sqrt(rgb.r * (1.0f - rgb.r));
+		return RGBSigmoidPolynomial(0.0f, 0.0f, Clamp(c2, -1e4f, 1e4f));
+	}
+
+	// Locate the color in the grid of its largest component
+	const int res = Resolution;
+	const int l = (rgb.r > rgb.g) ? (rgb.r > rgb.b ? 0 : 2) : (rgb.g > rgb.b ? 1 : 2);
+	const float z = rgb[l];
+	const float x = rgb[(l + 1) % 3] * (res - 1) / z;
+	const float y = rgb[(l + 2) % 3] * (res - 1) / z;
+
+	const int xi = std::min((int)x, res - 2), yi = std::min((int)y, res - 2);
+	const int zi = Clamp((int)(std::upper_bound(zNodes, zNodes + res, z) - zNodes) - 1, 0, res - 2);
+	const float dx = x - xi, dy = y - yi, dz = (z - zNodes[zi]) / (zNodes[zi + 1] - zNodes[zi]);
+
+	// Trilinear interpolation of the coefficients
+	float c[3];
+	for (int n = 0; n < 3; n++) {
+		auto co = [&](int di, int dj, int dk) {
+			return coefficients[((((size_t)l * res + zi + dk) * res + yi + dj) * res + xi + di) * 3 + n];
+		};
+		c[n] = Lerp(dz, Lerp(dy, Lerp(dx, co(0, 0, 0), co(1, 0, 0)), Lerp(dx, co(0, 1, 0), co(1, 1, 0))),
+				Lerp(dy, Lerp(dx, co(0, 0, 1), co(1, 0, 1)), Lerp(dx, co(0, 1, 1), co(1, 1, 1))));
+	}
+	return RGBSigmoidPolynomial(c[0], c[1], c[2]);
+}
+
+// The color is scaled to a largest component of 1/2, which leaves the sigmoid room on both sides
+RGBUnboundedSpectrum::RGBUnboundedSpectrum(const RGB& rgb) {
+	float m = std::max(rgb.r, std::max(rgb.g, rgb.b));
+	scale = 2.0f * m;
+	if (scale > 0.0f)
+		polynomial = RGBToSpectrumTable::Get()(rgb / scale);
+}
+
+}
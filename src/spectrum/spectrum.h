@@ -0,0 +1,73 @@
+#ifndef APOLLO_SPECTRUM_SPECTRUM_H
+#define APOLLO_SPECTRUM_SPECTRUM_H
+
+#include "apollo.h"
+#include "rgb.h"
+#include "sampledspectrum.h"
+
+namespace apollo {
+
+// Conversion between sampled spectra and RGB
+// ==========================================
+// RGB values use the linear sRGB primaries with an equal-energy white point, so a constant unit spectrum is (1, 1, 1)
+// The color matching functions are the analytic multi-lobe fit of Wyman et al., tabulated at 1 nm on first use
+
+// Monte Carlo estimate of the RGB color of a spectrum sampled at the given wavelengths; used at film splat time
+RGB SpectrumToRGB(const SampledSpectrum& s, const SampledWavelengths& lambda);
+
+// Smooth spectrum in [0, 1] given by a sigmoid of a quadratic polynomial in the normalized wavelength (Jakob and Hanika)
+class RGBSigmoidPolynomial {
+	public:
+		RGBSigmoidPolynomial() = default;
+		RGBSigmoidPolynomial(float c0, float c1, float c2) : c0(c0), c1(c1), c2(c2) {}
+
+		// Value at every sampled wavelength
+		SampledSpectrum Evaluate(const SampledWavelengths& lambda) const;
+
+		// Value at a single wavelength in nm
+		float Evaluate(float lambda) const;
+
+	private:
+		float c0 = 0.0f, c1 = 0.0f, c2 = 0.0f;
+};
+
+// Table of sigmoid polynomial coefficients that reproduce RGB colors in [0, 1]
+// The coefficients are fitted by Gauss-Newton on a res^3 grid for every choice of largest component when the table is first
+// requested (in parallel); lookups interpolate them trilinearly
+class RGBToSpectrumTable {
+	public:
+		// Shared table, built on the first call
+		static const RGBToSpectrumTable& Get();
+
+		// Spectrum of a reflectance color in [0, 1]
+		RGBSigmoidPolynomial operator()(const RGB& rgb) const;
+
+		// Grid resolution along every axis
+		static const int Resolution = 16;
+
+	private:
+		RGBToSpectrumTable();
+
+		// Grid positions of the largest component; denser near 0 and 1
+		float zNodes[Resolution];
+		// Coefficients indexed by [largest component][z][y][x][coefficient]
+		std::vector<float> coefficients;
+};
+
+// Spectrum of an RGB color with arbitrary magnitude, such as a light color
+class RGBUnboundedSpectrum {
+	public:
+		RGBUnboundedSpectrum(const RGB& rgb);
+
+		SampledSpectrum Sample(const SampledWavelengths& lambda) const {
+			return polynomial.Evaluate(lambda) * scale;
+		}
+
+	private:
+		float scale;
+		RGBSigmoidPolynomial polynomial;
+};
+
+}
+
+#endif
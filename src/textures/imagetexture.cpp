@@ -0,0 +1,43 @@
+#include "imagetexture.h"
+
+namespace apollo {
+
+// Image Texture
+// =============
+
+ImageTexture::ImageTexture(TextureCache& cache, int texture) : cache(cache), texture(texture) {}
+
+// The level is the base 2 logarithm of the number of full resolution texels the footprint spans
+RGB ImageTexture::Lookup(const Point2f& st, float width) const {
+	const TiledTextureInfo& info = cache.GetInfo(texture);
+	const Point2i& res = info.levelResolution[0];
+	// A non-finite footprint falls back to the full resolution level
+	float level = std::log2(std::max(width * std::max(res.x, res.y), 1e-8f));
+	level = std::isfinite(level) ? Clamp(level, 0.0f, (float)(info.Levels() - 1)) : 0.0f;
+	const int iLevel = (int)level;
+	const float delta = level - iLevel;
+
+	auto bilerp = [&](int l) {
+		const Point2i& r = info.levelResolution[l];
+		return cache.Bilerp(texture, l, Point2f(st.x * r.x, st.y * r.y));
+	};
+	if (delta == 0.0f || iLevel + 1 == info.Levels())
+		return bilerp(iLevel);
+	return bilerp(iLevel) * (1 - delta) + bilerp(iLevel + 1) * delta;
+}
+
+// The footprint is the larger of the (u, v) extents covered by one pixel step in x and y
+RGB ImageTexture::Evaluate(const SurfaceInteraction& si) const {
+	const float width = 2 * std::max(std::max(std::abs(si.dudx), std::abs(si.dudy)), std::max(std::abs(si.dvdx), std::abs(si.dvdy)));
+	return Lookup(si.uv(), width);
+}
+
+// Texture of a tiled texture file
+std::shared_ptr<ImageTexture> CreateImageTexture(TextureCache& cache, const std::string& filename) {
+	const int texture = cache.AddTexture(filename);
+	if (texture < 0)
+		return nullptr;
+	return std::make_shared<ImageTexture>(cache, texture);
+}
+
+}
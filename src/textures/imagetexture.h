@@ -0,0 +1,36 @@
+#ifndef APOLLO_TEXTURES_IMAGETEXTURE_H
+#define APOLLO_TEXTURES_IMAGETEXTURE_H
+
+#include "apollo.h"
+#include "interaction.h"
+#include "texturecache.h"
+
+namespace apollo {
+
+// RGB texture of a tiled image file, read through a texture cache
+// Lookups blend the two MIP levels whose texel spacing brackets the width of the footprint (trilinear filtering), so
+// only the tiles of the levels and regions that are actually seen are ever loaded
+// Texture coordinates wrap around; t runs down from the top row of the image
+class ImageTexture {
+	public:
+		// Texture registered in the cache under the given id
+		ImageTexture(TextureCache& cache, int texture);
+
+		// Filtered value at st for a square footprint of the given width, both in texture space
+		RGB Lookup(const Point2f& st, float width) const;
+
+		// Value at the (u, v) coordinates of a surface point, with the footprint taken from their screen space derivatives
+		// Without ray differentials the derivatives are zero and the full resolution level is interpolated bilinearly
+		RGB Evaluate(const SurfaceInteraction& si) const;
+
+	private:
+		TextureCache& cache;
+		const int texture;
+};
+
+// Texture of a tiled texture file made by MakeTiledTexture; returns nullptr if it cannot be read
+std::shared_ptr<ImageTexture> CreateImageTexture(TextureCache& cache, const std::string& filename);
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include "texturecache.h"
+#include "imageio.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+#include <cstring>
+#include <thread>
+
+namespace apollo {
+
+// Header of tiled texture files: magic, tile size, width, height and number of levels
+static const char TiledTextureMagic[8] = { 'A', 'P', 'O', 'L', 'L', 'O', 'T', 'X' };
+static constexpr size_t TiledTextureHeaderSize = sizeof(TiledTextureMagic) + 4 * sizeof(int32_t);
+
+// Resolutions of the MIP levels of an image, down to a single texel
+static std::vector<Point2i> MIPLevelResolutions(const Point2i& resolution) {
+	std::vector<Point2i> levels = { resolution };
+	while (levels.back().x > 1 || levels.back().y > 1)
+		levels.push_back(Point2i((levels.back().x + 1) / 2, (levels.back().y + 1) / 2));
+	return levels;
+}
+
+// Tiled Texture Files
+// ===================
+
+// Every level is written tile by tile, each tile row by row; tiles reaching past the border of a level repeat its
+// last row and column. Only the current level and the next, box filtered from it, are kept in memory
+bool MakeTiledTexture(const std::string& imageFilename, const std::string& tiledFilename) {
+	TRACE_SCOPE("Make tiled texture", "load");
+
+	std::vector<RGB> level;
+	Point2i resolution;
+	if (!ReadImage(imageFilename, &level, &resolution))
+		return false;
+
+	std::ofstream out(tiledFilename, std::ios::binary);
+	if (!out) {
+		std::cerr << "Cannot open " << tiledFilename << std::endl;
+		return false;
+	}
+
+	const std::vector<Point2i> levelResolution = MIPLevelResolutions(resolution);
+	const int32_t header[4] = { TextureTileSize, resolution.x, resolution.y, (int32_t)levelResolution.size() };
+	out.write(TiledTextureMagic, sizeof(TiledTextureMagic));
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	const int T = TextureTileSize;
+	std::vector<float> tile(3 * T * T);
+	for (size_t l = 0; l < levelResolution.size(); l++) {
+		const Point2i res = levelResolution[l];
+		for (int ty = 0; ty < (res.y + T - 1) / T; ty++) {
+			for (int tx = 0; tx < (res.x + T - 1) / T; tx++) {
+				for (int y = 0; y < T; y++) {
+					for (int x = 0; x < T; x++) {
+						const RGB& c = level[std::min(ty * T + y, res.y - 1) * res.x + std::min(tx * T + x, res.x - 1)];
+						for (int i = 0; i < 3; i++)
+							tile[3 * (y * T + x) + i] = c[i];
+					}
+				}
+				out.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(float));
+			}
+		}
+
+		if (l + 1 == levelResolution.size())
+			break;
+
+		// Average every 2x2 block of texels, repeating the last row and column of odd resolutions
+		const Point2i nextRes = levelResolution[l + 1];
+		std::vector<RGB> next((size_t)nextRes.x * nextRes.y);
+		ParallelFor([&](int64_t y) {
+			const int y0 = std::min(2 * (int)y, res.y - 1), y1 = std::min(2 * (int)y + 1, res.y - 1);
+			for (int x = 0; x < nextRes.x; x++) {
+				const int x0 = std::min(2 * x, res.x - 1), x1 = std::min(2 * x + 1, res.x - 1);
+				next[y * nextRes.x + x] = (level[y0 * res.x + x0] + level[y0 * res.x + x1] + level[y1 * res.x + x0] + level[y1 * res.x + x1]) * 0.25f;
+			}
+		}, nextRes.y, 16);
+		level.swap(next);
+	}
+
+	return (bool)out;
+}
+
+// Texture Cache
+// =============
+
+// Scramble the bits of a tile key, so that neighbouring tiles spread over the sets
+static inline uint64_t MixBits(uint64_t v) {
+	v ^= v >> 31;
+	v *= 0x7fb5d329728ea185ULL;
+	v ^= v >> 27;
+	v *= 0x81dadef4bc2dd44dULL;
+	v ^= v >> 33;
+	return v;
+}
+
+TextureCache::TextureCache(size_t maxBytes)
+	: nWays(Clamp(maxBytes / TileBytes, (size_t)1, (size_t)MaxWays)), nSets(std::max<size_t>(1, maxBytes / (nWays * TileBytes))),
+	  slots(new Slot[nSets * nWays]) {
+	if (maxBytes < TileBytes)
+		std::cerr << "Texture cache budget of " << maxBytes << " bytes is below one tile; using " << TileBytes << " bytes" << std::endl;
+}
+
+TextureCache::~TextureCache() {
+	for (size_t i = 0; i < nSets * nWays; i++)
+		delete[] slots[i].texels;
+}
+
+// Registration is not synchronized with lookups; all textures are added before rendering starts
+int TextureCache::AddTexture(const std::string& filename) {
+	std::unique_ptr<Texture> texture(new Texture());
+	texture->file.open(filename, std::ios::binary | std::ios::ate);
+	if (!texture->file) {
+		std::cerr << "Cannot open " << filename << std::endl;
+		return -1;
+	}
+	const uint64_t fileSize = (uint64_t)texture->file.tellg();
+	texture->file.seekg(0);
+
+	char magic[sizeof(TiledTextureMagic)];
+	int32_t header[4];
+	texture->file.read(magic, sizeof(magic));
+	texture->file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!texture->file || std::memcmp(magic, TiledTextureMagic, sizeof(magic)) != 0 || header[0] != TextureTileSize ||
+	    header[1] <= 0 || header[2] <= 0) {
+		std::cerr << "Invalid tiled texture file " << filename << std::endl;
+		return -1;
+	}
+
+	TiledTextureInfo& info = texture->info;
+	info.levelResolution = MIPLevelResolutions(Point2i(header[1], header[2]));
+	uint64_t offset = TiledTextureHeaderSize;
+	for (const Point2i& res : info.levelResolution) {
+		const int tilesX = (res.x + TextureTileSize - 1) / TextureTileSize;
+		const int tilesY = (res.y + TextureTileSize - 1) / TextureTileSize;
+		info.levelTilesX.push_back(tilesX);
+		info.levelOffset.push_back(offset);
+		offset += (uint64_t)tilesX * tilesY * TileBytes;
+	}
+	if (header[3] != info.Levels() || offset > fileSize || textures.size() >= 0xffff) {
+		std::cerr << "Invalid tiled texture file " << filename << std::endl;
+		return -1;
+	}
+
+	textures.push_back(std::move(texture));
+	return (int)textures.size() - 1;
+}
+
+// Texel (x, y) of a MIP level
+RGB TextureCache::Texel(int texture, int level, int x, int y) {
+	const int T = TextureTileSize;
+	Slot* slot = Pin(TileKey(texture, level, x / T, y / T));
+	const float* texel = &slot->texels[3 * ((y % T) * T + x % T)];
+	const RGB c(texel[0], texel[1], texel[2]);
+	Unpin(slot);
+	return c;
+}
+
+// The four texels usually share a tile, which is then pinned once for all of them
+RGB TextureCache::Bilerp(int texture, int level, const Point2f& p) {
+	const Point2i& res = textures[texture]->info.levelResolution[level];
+
+	// Wrap in floating point, so that huge or non-finite coordinates never reach an integer conversion
+	auto wrap = [](float v, int n) {
+		if (!std::isfinite(v))
+			return 0.0f;
+		return Clamp(v - n * std::floor(v / n), 0.0f, (float)n);
+	};
+	const float px = wrap(p.x - 0.5f, res.x), py = wrap(p.y - 0.5f, res.y);
+	const float fx = std::floor(px), fy = std::floor(py);
+	const float dx = px - fx, dy = py - fy;
+
+	const int x0 = (int)fx % res.x, x1 = (x0 + 1) % res.x;
+	const int y0 = (int)fy % res.y, y1 = (y0 + 1) % res.y;
+
+	const int T = TextureTileSize;
+	if (x0 / T != x1 / T || y0 / T != y1 / T) {
+		return Texel(texture, level, x0, y0) * ((1 - dx) * (1 - dy)) + Texel(texture, level, x1, y0) * (dx * (1 - dy)) +
+			Texel(texture, level, x0, y1) * ((1 - dx) * dy) + Texel(texture, level, x1, y1) * (dx * dy);
+	}
+
+	Slot* slot = Pin(TileKey(texture, level, x0 / T, y0 / T));
+	auto texel = [&](int x, int y) {
+		const float* t = &slot->texels[3 * ((y % T) * T + x % T)];
+		return RGB(t[0], t[1], t[2]);
+	};
+	const RGB c = texel(x0, y0) * ((1 - dx) * (1 - dy)) + texel(x1, y0) * (dx * (1 - dy)) +
+		texel(x0, y1) * ((1 - dx) * dy) + texel(x1, y1) * (dx * dy);
+	Unpin(slot);
+	return c;
+}
+
+// Find the tile in its set, or load it on a miss
+TextureCache::Slot* TextureCache::Pin(uint64_t key) {
+	STAT_INC(TextureTileLookups);
+	const size_t set = MixBits(key) % nSets;
+	Slot* ways = &slots[set * nWays];
+	for (size_t i = 0; i < nWays; i++)
+		if (ways[i].key.load(std::memory_order_relaxed) == key && TryPin(&ways[i], key))
+			return &ways[i];
+	return Load(key, set);
+}
+
+// The pin is taken before the key is checked: once it is held the slot cannot be replaced, and a slot that is being
+// replaced has a negative count. Acquiring the pin synchronizes with the release at the end of the slot's last fill
+bool TextureCache::TryPin(Slot* slot, uint64_t key) {
+	if (slot->pins.fetch_add(1, std::memory_order_acquire) < 0) {
+		slot->pins.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+	if (slot->key.load(std::memory_order_relaxed) != key) {
+		Unpin(slot);
+		return false;
+	}
+
+	// Only write the use time when it changed, so that hot tiles don't bounce their cache line between cores
+	const uint32_t now = useClock.load(std::memory_order_relaxed);
+	if (slot->lastUse.load(std::memory_order_relaxed) != now)
+		slot->lastUse.store(now, std::memory_order_relaxed);
+	return true;
+}
+
+// Replace a slot of the set with the tile
+// Empty slots are filled first, then the unpinned slot that has gone unused for the most misses is evicted. The slot is
+// claimed by swapping its pin count from zero to Replacing, which fails while any reader holds it
+TextureCache::Slot* TextureCache::Load(uint64_t key, size_t set) {
+	std::lock_guard<std::mutex> lock(shardMutexes[set % NShards]);
+	Slot* ways = &slots[set * nWays];
+
+	// Another thread may have loaded the tile while this one waited for the lock
+	for (size_t i = 0; i < nWays; i++)
+		if (ways[i].key.load(std::memory_order_relaxed) == key && TryPin(&ways[i], key))
+			return &ways[i];
+
+	Slot* victim = nullptr;
+	while (!victim) {
+		const uint32_t now = useClock.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < nWays; i++) {
+			if (ways[i].pins.load(std::memory_order_relaxed) != 0)
+				continue;
+			if (ways[i].key.load(std::memory_order_relaxed) == EmptyKey) {
+				victim = &ways[i];
+				break;
+			}
+			if (!victim || now - ways[i].lastUse.load(std::memory_order_relaxed) > now - victim->lastUse.load(std::memory_order_relaxed))
+				victim = &ways[i];
+		}
+
+		int32_t unpinned = 0;
+		if (!victim || !victim->pins.compare_exchange_strong(unpinned, Replacing, std::memory_order_acquire)) {
+			// Every slot of the set is being read; pins are only held for a few texel reads
+			victim = nullptr;
+			std::this_thread::yield();
+		}
+	}
+
+	STAT_INC(TextureTileMisses);
+	if (victim->key.load(std::memory_order_relaxed) == EmptyKey)
+		residentTiles.fetch_add(1, std::memory_order_relaxed);
+	if (!victim->texels)
+		victim->texels = new float[TileBytes / sizeof(float)];
+
+	ReadTile(key, victim->texels);
+	victim->key.store(key, std::memory_order_relaxed);
+	victim->lastUse.store(useClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	// Publish the tile and keep it pinned for the caller
+	victim->pins.fetch_add(1 - Replacing, std::memory_order_release);
+	return victim;
+}
+
+// Read the texels of a tile from its texture file
+void TextureCache::ReadTile(uint64_t key, float* texels) {
+	TRACE_SCOPE("Read texture tile", "load");
+	Texture& texture = *textures[key >> 48];
+	const int level = (int)((key >> 40) & 0xff);
+	const int tileX = (int)((key >> 20) & 0xfffff), tileY = (int)(key & 0xfffff);
+	const uint64_t offset = texture.info.levelOffset[level] + ((uint64_t)tileY * texture.info.levelTilesX[level] + tileX) * TileBytes;
+
+	std::lock_guard<std::mutex> lock(texture.fileMutex);
+	texture.file.seekg(offset);
+	texture.file.read(reinterpret_cast<char*>(texels), TileBytes);
+	if (!texture.file) {
+		// The layout was validated when the texture was added, so this only happens if the file changed since
+		std::cerr << "Cannot read texture tile at offset " << offset << std::endl;
+		texture.file.clear();
+		std::fill(texels, texels + TileBytes / sizeof(float), 0.0f);
+	}
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef APOLLO_TEXTURES_TEXTURECACHE_H
+#define APOLLO_TEXTURES_TEXTURECACHE_H
+
+#include "apollo.h"
+#include "point2.h"
+#include "rgb.h"
+#include <atomic>
+#include <mutex>
+
+namespace apollo {
+
+// Width and height of the square tiles textures are stored, loaded and cached in
+static constexpr int TextureTileSize = 64;
+
+// Convert a .pfm or .hdr image into a tiled texture file holding its whole MIP pyramid
+// The image is only resident during the conversion; rendering then reads single tiles of single levels from the file.
+// Every level halves the resolution of the one above (rounding up) with a box filter, down to a single texel
+bool MakeTiledTexture(const std::string& imageFilename, const std::string& tiledFilename);
+
+// Layout of a tiled texture file
+struct TiledTextureInfo {
+	// Number of MIP levels; level 0 has the full resolution
+	int Levels() const { return (int)levelResolution.size(); }
+
+	std::vector<Point2i> levelResolution;
+	// Number of tiles along x of every level, and the file offset of its first tile
+	std::vector<int> levelTilesX;
+	std::vector<uint64_t> levelOffset;
+};
+
+// Cache of texture tiles with a fixed memory budget, shared by all render threads
+// The cache is set associative: a tile can only live in the few slots of the set its key hashes to, so a lookup
+// inspects just that set and needs no central index. Hits are lock-free; they pin the slot with an atomic counter so
+// that it cannot be replaced while its texels are read. Misses lock the shard of the set, evict its least recently
+// used unpinned slot and read the tile from the texture file, which only stalls misses in the same shard
+class TextureCache {
+	public:
+		// Cache holding at most maxBytes of texels
+		// Budgets below a full set use fewer ways per set; a budget below one tile is reported and still holds one tile
+		explicit TextureCache(size_t maxBytes);
+		~TextureCache();
+
+		// Register a tiled texture file made by MakeTiledTexture; returns the texture id, or -1 if it cannot be read
+		int AddTexture(const std::string& filename);
+
+		// Layout of a registered texture
+		const TiledTextureInfo& GetInfo(int texture) const { return textures[texture]->info; }
+
+		// Texel (x, y) of a MIP level, which must lie inside the level
+		RGB Texel(int texture, int level, int x, int y);
+
+		// Bilinearly interpolated texels around the continuous texel position p of a MIP level, wrapping around the borders
+		// Non-finite coordinates are treated as 0
+		RGB Bilerp(int texture, int level, const Point2f& p);
+
+		// Memory budget and the number of bytes of tiles currently resident
+		size_t MaxBytes() const { return nSets * nWays * TileBytes; }
+		size_t ResidentBytes() const { return (size_t)residentTiles.load(std::memory_order_relaxed) * TileBytes; }
+
+	private:
+		// Ways of a set when the budget allows it
+		static constexpr int MaxWays = 8;
+		static constexpr int NShards = 64;
+		static constexpr size_t TileBytes = (size_t)TextureTileSize * TextureTileSize * 3 * sizeof(float);
+		static constexpr uint64_t EmptyKey = ~0ULL;
+		// Pin count of a slot while it is being replaced; keeps the count negative whatever readers add to it
+		static constexpr int32_t Replacing = -(1 << 30);
+
+		// Slot of the cache; texels are allocated when the slot is first filled and reused afterwards
+		struct Slot {
+			std::atomic<uint64_t> key{ EmptyKey };
+			std::atomic<int32_t> pins{ 0 };
+			std::atomic<uint32_t> lastUse{ 0 };
+			float* texels = nullptr;
+		};
+
+		struct Texture {
+			TiledTextureInfo info;
+			// Tiles are read through a single stream
+			std::ifstream file;
+			std::mutex fileMutex;
+		};
+
+		// Key of a tile: texture (16 bits), level (8 bits) and tile coordinates (20 bits each)
+		static uint64_t TileKey(int texture, int level, int tileX, int tileY) {
+			return ((uint64_t)texture << 48) | ((uint64_t)level << 40) | ((uint64_t)tileX << 20) | (uint64_t)tileY;
+		}
+
+		// Find the tile in its set, or load it on a miss; the returned slot is pinned until Unpin
+		Slot* Pin(uint64_t key);
+		static void Unpin(Slot* slot) { slot->pins.fetch_sub(1, std::memory_order_release); }
+
+		// Pin a slot if it still holds the tile
+		bool TryPin(Slot* slot, uint64_t key);
+
+		// Replace a slot of the set with the tile, under the lock of the set's shard
+		Slot* Load(uint64_t key, size_t set);
+
+		// Read the texels of a tile from its texture file
+		void ReadTile(uint64_t key, float* texels);
+
+		size_t nWays, nSets;
+		std::unique_ptr<Slot[]> slots;
+		std::mutex shardMutexes[NShards];
+		// Advanced on every miss; slots remember when they were last used to choose the victims of later misses
+		std::atomic<uint32_t> useClock{ 0 };
+		std::atomic<int64_t> residentTiles{ 0 };
+		std::vector<std::unique_ptr<Texture>> textures;
+};
+
+}
+
+#endif